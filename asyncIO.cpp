@@ -0,0 +1,472 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+//START PREFETCHING
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This constructor sets up depth buffers of chunkSize bytes each and starts
+ * a thread that reads the source into them, ahead of whoever is reading from
+ * this buffer.
+ *
+ * @param[in]  source - stream buffer to read from, such as fin.rdbuf().
+ * @param[in]  chunkSize - number of bytes read from the source at a time.
+ * @param[in]  depth - number of chunks that may be read ahead.
+ *
+ * @par Example
+ * @verbatim
+   ifstream fin;
+   openIPFile(fin, "steve.ppm");
+   prefetchBuf ahead(fin.rdbuf());
+   istream in(&ahead); //reads from in no longer wait on the disk
+   @endverbatim
+ *****************************************************************************/
+prefetchBuf::prefetchBuf(streambuf* source, size_t chunkSize, int depth)
+    : source(source), chunkSize(chunkSize), current(-1), finished(false),
+      stopping(false)
+{
+    int i;
+
+    buffers.resize(depth);
+    lengths.resize(depth, 0);
+
+    for (i = 0; i < depth; i++)
+    {
+        buffers[i].resize(chunkSize);
+        empty.push_back(i);
+    }
+
+    trackMemory((long long)chunkSize * depth);
+    setg(nullptr, nullptr, nullptr);
+
+    reader = thread(&prefetchBuf::fill, this);
+}
+
+//STOP PREFETCHING
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This destructor tells the reading thread to stop and waits for it. Bytes
+ * the thread read ahead but nobody consumed are lost to the source.
+ *
+ * @par Example
+ * @verbatim
+   {
+       prefetchBuf ahead(fin.rdbuf());
+       //read from ahead
+   } //reading thread stops here
+   @endverbatim
+ *****************************************************************************/
+prefetchBuf::~prefetchBuf()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+
+    changed.notify_all();
+    reader.join();
+
+    trackMemory(-(long long)chunkSize * buffers.size());
+}
+
+//READING THREAD
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function runs on the reading thread. It fills free buffers from the
+ * source, in order, until the source runs out or the buffer is destroyed.
+ *
+ * @par Example
+ * @verbatim
+   reader = thread(&prefetchBuf::fill, this);
+   @endverbatim
+ *****************************************************************************/
+void prefetchBuf::fill()
+{
+    profileThread();
+
+    while (true)
+    {
+        int index;
+        streamsize got;
+
+        {
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [&] { return stopping || !empty.empty(); });
+
+            if (stopping)
+            {
+                return;
+            }
+
+            index = empty.front();
+            empty.pop_front();
+        }
+
+        got = source->sgetn(buffers[index].data(), streamsize(chunkSize));
+
+        if (got < 0)
+        {
+            got = 0;
+        }
+
+        {
+            lock_guard<mutex> guard(lock);
+            lengths[index] = size_t(got);
+            ready.push_back(index);
+
+            if (size_t(got) < chunkSize)
+            {
+                finished = true;
+            }
+        }
+
+        changed.notify_all();
+
+        if (size_t(got) < chunkSize)
+        {
+            return;
+        }
+    }
+}
+
+//NEXT CHUNK
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function is called by the stream when the current chunk has been
+ * used up. It hands the chunk back to the reading thread and switches to
+ * the next chunk, waiting for it only if the reading thread is behind.
+ *
+ * @return the next character, or end of file once the source runs out.
+ *
+ * @par Example
+ * @verbatim
+   istream in(&ahead);
+   int c = in.get(); //calls underflow whenever a chunk is used up
+   @endverbatim
+ *****************************************************************************/
+prefetchBuf::int_type prefetchBuf::underflow()
+{
+    if (gptr() < egptr())
+    {
+        return traits_type::to_int_type(*gptr());
+    }
+
+    unique_lock<mutex> guard(lock);
+
+    //A ZERO LENGTH CHUNK ONLY MARKS THE END OF THE SOURCE
+    do
+    {
+        if (current >= 0)
+        {
+            empty.push_back(current);
+            current = -1;
+            changed.notify_all();
+        }
+
+        changed.wait(guard, [&] { return finished || !ready.empty(); });
+
+        if (ready.empty())
+        {
+            setg(nullptr, nullptr, nullptr);
+            return traits_type::eof();
+        }
+
+        current = ready.front();
+        ready.pop_front();
+    } while (lengths[current] == 0);
+
+    char* start = buffers[current].data();
+    setg(start, start, start + lengths[current]);
+
+    return traits_type::to_int_type(*gptr());
+}
+
+//LOOK AT BUFFERED BYTES
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function gives direct access to the bytes of the current chunk that
+ * have not been read yet, fetching the next chunk first if the current one
+ * is used up. The bytes stay unread until consume is called, so a decoder
+ * can scan a whole chunk in place and take only the part it needs.
+ *
+ * @param[out]  data - set to the first unread byte.
+ *
+ * @return number of bytes available at data, 0 at the end of the source.
+ *
+ * @par Example
+ * @verbatim
+   const char* data;
+   size_t length = ahead.peek(data);
+   ahead.consume(length); //all of them are read now
+   @endverbatim
+ *****************************************************************************/
+size_t prefetchBuf::peek(const char*& data)
+{
+    if (sgetc() == traits_type::eof())
+    {
+        return 0;
+    }
+
+    data = gptr();
+
+    return size_t(egptr() - gptr());
+}
+
+//MARK BYTES AS READ
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function marks bytes returned by peek as read.
+ *
+ * @param[in]  count - number of bytes, no more than peek returned.
+ *
+ * @par Example
+ * @verbatim
+   size_t length = ahead.peek(data);
+   ahead.consume(length / 2); //the second half is read next
+   @endverbatim
+ *****************************************************************************/
+void prefetchBuf::consume(size_t count)
+{
+    gbump(int(count));
+}
+
+//START WRITE BEHIND
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This constructor sets up depth buffers of chunkSize bytes each and starts
+ * a thread that writes full buffers to the sink, behind whoever is writing
+ * into this buffer.
+ *
+ * @param[in]  sink - stream buffer to write to, such as fout.rdbuf().
+ * @param[in]  chunkSize - number of bytes handed to the sink at a time.
+ * @param[in]  depth - number of chunks that may wait to be written.
+ *
+ * @par Example
+ * @verbatim
+   ofstream fout;
+   openOPFile(fout, "steve.ppm");
+   writeBehindBuf behind(fout.rdbuf());
+   ostream out(&behind); //writes to out no longer wait on the disk
+   @endverbatim
+ *****************************************************************************/
+writeBehindBuf::writeBehindBuf(streambuf* sink, size_t chunkSize, int depth)
+    : sink(sink), chunkSize(chunkSize), current(0), failed(false),
+      stopping(false)
+{
+    int i;
+
+    buffers.resize(depth);
+    lengths.resize(depth, 0);
+
+    for (i = 0; i < depth; i++)
+    {
+        buffers[i].resize(chunkSize);
+    }
+
+    for (i = 1; i < depth; i++)
+    {
+        empty.push_back(i);
+    }
+
+    trackMemory((long long)chunkSize * depth);
+    setp(buffers[0].data(), buffers[0].data() + chunkSize);
+
+    writer = thread(&writeBehindBuf::drain, this);
+}
+
+//STOP WRITE BEHIND
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This destructor writes out whatever is still buffered, then stops the
+ * writing thread and waits for it.
+ *
+ * @par Example
+ * @verbatim
+   {
+       writeBehindBuf behind(fout.rdbuf());
+       //write to behind
+   } //everything is in fout here
+   @endverbatim
+ *****************************************************************************/
+writeBehindBuf::~writeBehindBuf()
+{
+    sync();
+
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+
+    changed.notify_all();
+    writer.join();
+
+    trackMemory(-(long long)chunkSize * buffers.size());
+}
+
+//WRITING THREAD
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function runs on the writing thread. It writes full buffers to the
+ * sink in the order they were handed over, until the buffer is destroyed.
+ *
+ * @par Example
+ * @verbatim
+   writer = thread(&writeBehindBuf::drain, this);
+   @endverbatim
+ *****************************************************************************/
+void writeBehindBuf::drain()
+{
+    profileThread();
+
+    while (true)
+    {
+        int index;
+
+        {
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [&] { return stopping || !full.empty(); });
+
+            if (full.empty())
+            {
+                return;
+            }
+
+            index = full.front();
+        }
+
+        streamsize put = sink->sputn(buffers[index].data(), streamsize(lengths[index]));
+
+        {
+            lock_guard<mutex> guard(lock);
+
+            if (put != streamsize(lengths[index]))
+            {
+                failed = true;
+            }
+
+            full.pop_front();
+            empty.push_back(index);
+        }
+
+        changed.notify_all();
+    }
+}
+
+//HAND OVER CURRENT BUFFER
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function queues the current buffer for the writing thread and makes
+ * a free buffer current, waiting for one only if the writing thread is
+ * behind.
+ *
+ * @par Example
+ * @verbatim
+   submit(); //pptr() now points at the start of an empty buffer
+   @endverbatim
+ *****************************************************************************/
+void writeBehindBuf::submit()
+{
+    unique_lock<mutex> guard(lock);
+
+    lengths[current] = size_t(pptr() - pbase());
+
+    if (lengths[current] > 0)
+    {
+        full.push_back(current);
+        changed.notify_all();
+
+        changed.wait(guard, [&] { return !empty.empty(); });
+
+        current = empty.front();
+        empty.pop_front();
+    }
+
+    setp(buffers[current].data(), buffers[current].data() + chunkSize);
+}
+
+//BUFFER FULL
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function is called by the stream when the current buffer is full.
+ * It hands the buffer to the writing thread and stores c in a fresh one.
+ *
+ * @param[in]  c - character that did not fit, or end of file for none.
+ *
+ * @return c, or end of file if an earlier write failed.
+ *
+ * @par Example
+ * @verbatim
+   ostream out(&behind);
+   out.put('x'); //calls overflow whenever a buffer fills up
+   @endverbatim
+ *****************************************************************************/
+writeBehindBuf::int_type writeBehindBuf::overflow(int_type c)
+{
+    submit();
+
+    if (failed)
+    {
+        return traits_type::eof();
+    }
+
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+
+    return traits_type::not_eof(c);
+}
+
+//WAIT FOR WRITES
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function hands over the current buffer and waits until the writing
+ * thread has written everything, then flushes the sink.
+ *
+ * @return 0 on success, -1 if any write failed.
+ *
+ * @par Example
+ * @verbatim
+   out.flush(); //calls sync, the data is now in the sink
+   @endverbatim
+ *****************************************************************************/
+int writeBehindBuf::sync()
+{
+    submit();
+
+    unique_lock<mutex> guard(lock);
+    changed.wait(guard, [&] { return full.empty(); });
+
+    if (failed || sink->pubsync() == -1)
+    {
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,483 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Number of pixels whose squared differences are summed in 32 bit lanes
+* before the lanes are added into 64 bits, few enough that no lane can
+* overflow.
+************************************************************************/
+const int SQUARE_BLOCK = 65536;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Width and height of the windows SSIM is measured over, and the distance
+* between the corners of neighbouring windows.
+************************************************************************/
+const int SSIM_WINDOW = 8;
+const int SSIM_STEP = 4;
+
+//MAXIMUM DIFFERENCE OF A ROW
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function returns the largest difference between the pixels of two
+ * rows. With SSE2, 16 pixels are done at a time, the difference taken as
+ * the two saturated subtractions joined together.
+ *
+ * @param[in]  a - first row.
+ * @param[in]  b - second row.
+ * @param[in]  count - number of pixels in the rows.
+ *
+ * @return largest difference, from 0 to 255.
+ *
+ * @par Example
+ * @verbatim
+   int most = maxDiffRow(ref.redGray[i], img.redGray[i], img.cols);
+   @endverbatim
+ *****************************************************************************/
+static int maxDiffRow(const pixel* a, const pixel* b, int count)
+{
+    int most = 0;
+    int j = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128i best = _mm_setzero_si128();
+    pixel lanes[16];
+
+    for (; j + 16 <= count; j += 16)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + j));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+
+        best = _mm_max_epu8(best, _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va)));
+    }
+
+    _mm_storeu_si128((__m128i*)lanes, best);
+
+    for (int k = 0; k < 16; k++)
+    {
+        most = max(most, int(lanes[k]));
+    }
+#endif
+
+    for (; j < count; j++)
+    {
+        most = max(most, abs(a[j] - b[j]));
+    }
+
+    return most;
+}
+
+//SQUARED DIFFERENCE OF A ROW
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function returns the sum of the squared differences between the
+ * pixels of two rows. With SSE2, 16 pixels are done at a time: the absolute
+ * differences are widened to 16 bits and squared and summed in pairs by a
+ * multiply add, into 32 bit lanes that are added into the total every
+ * SQUARE_BLOCK pixels.
+ *
+ * @param[in]  a - first row.
+ * @param[in]  b - second row.
+ * @param[in]  count - number of pixels in the rows.
+ *
+ * @return sum of the squared differences.
+ *
+ * @par Example
+ * @verbatim
+   long long error = squaredRow(ref.green[i], img.green[i], img.cols);
+   @endverbatim
+ *****************************************************************************/
+static long long squaredRow(const pixel* a, const pixel* b, int count)
+{
+    long long total = 0;
+    int j = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128();
+
+    while (j + 16 <= count)
+    {
+        int stop = min(count, j + SQUARE_BLOCK);
+        __m128i sum = zero;
+        int lanes[4];
+
+        for (; j + 16 <= stop; j += 16)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i*)(a + j));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+            __m128i diff = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+            __m128i lo = _mm_unpacklo_epi8(diff, zero);
+            __m128i hi = _mm_unpackhi_epi8(diff, zero);
+
+            sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+        }
+
+        _mm_storeu_si128((__m128i*)lanes, sum);
+        total += (long long)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+    for (; j < count; j++)
+    {
+        int diff = a[j] - b[j];
+
+        total += diff * diff;
+    }
+
+    return total;
+}
+
+//SSIM OF A WINDOW
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function returns the structural similarity of one window of two
+ * planes, from the means, variances and covariance of its pixels. With
+ * SSE2 and a full 8 pixel wide window, each row of the window is widened to
+ * 16 bits and its sums of products are taken by multiply adds.
+ *
+ * @param[in]  a - first plane.
+ * @param[in]  b - second plane.
+ * @param[in]  row - top row of the window.
+ * @param[in]  col - left column of the window.
+ * @param[in]  height - number of rows in the window.
+ * @param[in]  width - number of columns in the window.
+ *
+ * @return similarity of the window, 1 when the windows are the same.
+ *
+ * @par Example
+ * @verbatim
+   double similarity = windowSSIM(ref.blue, img.blue, 4, 8, 8, 8);
+   @endverbatim
+ *****************************************************************************/
+static double windowSSIM(pixel** a, pixel** b, int row, int col, int height, int width)
+{
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+    long long sumA = 0;
+    long long sumB = 0;
+    long long sumAA = 0;
+    long long sumBB = 0;
+    long long sumAB = 0;
+    int i = 0;
+    int j;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    if (width == SSIM_WINDOW)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i totals = zero;
+        __m128i squaresA = zero;
+        __m128i squaresB = zero;
+        __m128i products = zero;
+        int lanes[4];
+
+        for (; i < height; i++)
+        {
+            __m128i va = _mm_loadl_epi64((const __m128i*)(a[row + i] + col));
+            __m128i vb = _mm_loadl_epi64((const __m128i*)(b[row + i] + col));
+            __m128i wa = _mm_unpacklo_epi8(va, zero);
+            __m128i wb = _mm_unpacklo_epi8(vb, zero);
+
+            //THE SUM OF ABSOLUTE DIFFERENCES FROM 0 IS THE SUM OF THE PIXELS
+            totals = _mm_add_epi32(totals, _mm_unpacklo_epi64(_mm_sad_epu8(va, zero),
+                _mm_sad_epu8(vb, zero)));
+            squaresA = _mm_add_epi32(squaresA, _mm_madd_epi16(wa, wa));
+            squaresB = _mm_add_epi32(squaresB, _mm_madd_epi16(wb, wb));
+            products = _mm_add_epi32(products, _mm_madd_epi16(wa, wb));
+        }
+
+        _mm_storeu_si128((__m128i*)lanes, totals);
+        sumA = lanes[0];
+        sumB = lanes[2];
+        _mm_storeu_si128((__m128i*)lanes, squaresA);
+        sumAA = (long long)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        _mm_storeu_si128((__m128i*)lanes, squaresB);
+        sumBB = (long long)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        _mm_storeu_si128((__m128i*)lanes, products);
+        sumAB = (long long)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+    for (; i < height; i++)
+    {
+        for (j = 0; j < width; j++)
+        {
+            int x = a[row + i][col + j];
+            int y = b[row + i][col + j];
+
+            sumA += x;
+            sumB += y;
+            sumAA += x * x;
+            sumBB += y * y;
+            sumAB += x * y;
+        }
+    }
+
+    double n = double(height) * width;
+    double meanA = sumA / n;
+    double meanB = sumB / n;
+    double varA = sumAA / n - meanA * meanA;
+    double varB = sumBB / n - meanB * meanB;
+    double covariance = sumAB / n - meanA * meanB;
+
+    return (2 * meanA * meanB + c1) * (2 * covariance + c2) /
+        ((meanA * meanA + meanB * meanB + c1) * (varA + varB + c2));
+}
+
+//SAME PLANES
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function checks whether the planes of two images of the same size
+ * hold the same pixels. The bands of rows are compared on separate threads,
+ * and every thread stops as soon as any of them finds a row that differs.
+ *
+ * @param[in]  a - planes of the first image.
+ * @param[in]  b - planes of the second image.
+ * @param[in]  planes - number of planes to compare.
+ * @param[in]  rows - number of rows in the images.
+ * @param[in]  cols - number of columns in the images.
+ *
+ * @return true if every pixel is the same.
+ *
+ * @par Example
+ * @verbatim
+   pixel** first[3] = { ref.redGray, ref.green, ref.blue };
+   pixel** second[3] = { img.redGray, img.green, img.blue };
+   if (samePlanes(first, second, 3, img.rows, img.cols))
+   {
+       cout << "Identical: yes" << endl;
+   }
+   @endverbatim
+ *****************************************************************************/
+static bool samePlanes(pixel*** a, pixel*** b, int planes, int rows, int cols)
+{
+    atomic<bool> differ(false);
+
+    parallelBands(rows, [&](int, int first, int last)
+    {
+        for (int i = first; i < last && !differ.load(memory_order_relaxed); i++)
+        {
+            for (int p = 0; p < planes; p++)
+            {
+                if (memcmp(a[p][i], b[p][i], cols) != 0)
+                {
+                    differ = true;
+                    return;
+                }
+            }
+        }
+    });
+
+    return !differ;
+}
+
+//COMPARE IMAGES
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads two images, such as an output and its golden file,
+ * and prints whether they are identical and how far apart they are by the
+ * metric given: exact for the check alone, maxdiff for the largest
+ * difference of any sample, psnr for the mean squared error and the peak
+ * signal to noise ratio, or ssim for the structural similarity averaged
+ * over 8 by 8 windows, 4 pixels apart, of every plane. The exact check is
+ * made first and stops at the first row that differs, and identical images
+ * skip the metric. The alpha channel is compared when both images have
+ * one, and an image with alpha never matches one without.
+ *
+ * @param[in]  mode - exact, maxdiff, psnr or ssim.
+ * @param[in]  reference - name of the image to compare against.
+ * @param[in]  candidate - name of the image to check.
+ *
+ * @return 0 if the images are identical, 1 if they differ and 2 if either
+ *         cannot be read.
+ *
+ * @par Example
+ * @verbatim
+   int status = compareImages("psnr", "test files/sepiabb.ppm", "sepiabb.ppm");
+   //prints
+   //Identical: no
+   //MSE: 0.0312
+   //PSNR: 63.1916 dB
+   @endverbatim
+ *****************************************************************************/
+int compareImages(string mode, string reference, string candidate)
+{
+    string names[2] = { reference, candidate };
+    image img[2];
+    int k;
+
+    for (k = 0; k < 2; k++)
+    {
+        ifstream fin(names[k], ios::binary);
+
+        if (!fin.is_open())
+        {
+            cout << "Unable to open the file: " << names[k] << endl;
+            return 2;
+        }
+
+        if (!readImage(fin, img[k]))
+        {
+            cout << "Unable to read the image: " << names[k] << endl;
+            return 2;
+        }
+    }
+
+    if (img[0].rows != img[1].rows || img[0].cols != img[1].cols)
+    {
+        cout << "Sizes differ: " << img[0].cols << " by " << img[0].rows << " and "
+            << img[1].cols << " by " << img[1].rows << endl;
+        cout << "Identical: no" << endl;
+        freeimage(img[0]);
+        freeimage(img[1]);
+        return 1;
+    }
+
+    int rows = img[0].rows;
+    int cols = img[0].cols;
+    bool bothAlpha = img[0].alpha != nullptr && img[1].alpha != nullptr;
+    bool oneAlpha = (img[0].alpha != nullptr) != (img[1].alpha != nullptr);
+    int planes = bothAlpha ? 4 : 3;
+    pixel** refPlanes[4] = { img[0].redGray, img[0].green, img[0].blue, img[0].alpha };
+    pixel** imgPlanes[4] = { img[1].redGray, img[1].green, img[1].blue, img[1].alpha };
+    bool identical = !oneAlpha && samePlanes(refPlanes, imgPlanes, planes, rows, cols);
+
+    if (oneAlpha)
+    {
+        cout << "Alpha differs: only one of the images has an alpha channel" << endl;
+    }
+
+    cout << "Identical: " << (identical ? "yes" : "no") << endl;
+
+    if (mode == "maxdiff")
+    {
+        vector<int> most(bandCount(rows), 0);
+        int largest = 0;
+
+        if (!identical)
+        {
+            parallelBands(rows, [&](int band, int first, int last)
+            {
+                for (int i = first; i < last; i++)
+                {
+                    for (int p = 0; p < planes; p++)
+                    {
+                        most[band] = max(most[band], maxDiffRow(refPlanes[p][i], imgPlanes[p][i], cols));
+                    }
+                }
+            });
+        }
+
+        for (int value : most)
+        {
+            largest = max(largest, value);
+        }
+
+        cout << "Max difference: " << largest << endl;
+    }
+    else if (mode == "psnr")
+    {
+        vector<long long> sums(bandCount(rows), 0);
+        long long total = 0;
+
+        if (!identical)
+        {
+            parallelBands(rows, [&](int band, int first, int last)
+            {
+                for (int i = first; i < last; i++)
+                {
+                    for (int p = 0; p < planes; p++)
+                    {
+                        sums[band] += squaredRow(refPlanes[p][i], imgPlanes[p][i], cols);
+                    }
+                }
+            });
+        }
+
+        for (long long value : sums)
+        {
+            total += value;
+        }
+
+        double mse = double(total) / ((double)rows * cols * planes);
+
+        cout << fixed << setprecision(4);
+        cout << "MSE: " << mse << endl;
+
+        if (total == 0)
+        {
+            cout << "PSNR: infinite" << endl;
+        }
+        else
+        {
+            cout << "PSNR: " << 10 * log10(255.0 * 255.0 / mse) << " dB" << endl;
+        }
+    }
+    else if (mode == "ssim")
+    {
+        int height = min(SSIM_WINDOW, rows);
+        int width = min(SSIM_WINDOW, cols);
+        int down = (rows - height) / SSIM_STEP + 1;
+        int across = (cols - width) / SSIM_STEP + 1;
+        vector<double> sums(bandCount(down), 0);
+        double total = 0;
+
+        if (!identical)
+        {
+            parallelBands(down, [&](int band, int first, int last)
+            {
+                for (int i = first; i < last; i++)
+                {
+                    for (int j = 0; j < across; j++)
+                    {
+                        for (int p = 0; p < planes; p++)
+                        {
+                            sums[band] += windowSSIM(refPlanes[p], imgPlanes[p], i * SSIM_STEP,
+                                j * SSIM_STEP, height, width);
+                        }
+                    }
+                }
+            });
+
+            for (double value : sums)
+            {
+                total += value;
+            }
+
+            total /= (double)down * across * planes;
+        }
+        else
+        {
+            total = 1;
+        }
+
+        cout << fixed << setprecision(6);
+        cout << "SSIM: " << total << endl;
+    }
+
+    freeimage(img[0]);
+    freeimage(img[1]);
+
+    return identical ? 0 : 1;
+}
@@ -0,0 +1,313 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* 8 by 8 Bayer matrix, the order in which the pixels of each 8 by 8 block
+* turn white as the gray level rises.
+************************************************************************/
+const int BAYER[8][8] =
+{
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Number of columns of a row Floyd Steinberg dithers before telling the
+* row below how far it has got.
+************************************************************************/
+const int DITHER_CHUNK = 64;
+
+//GRAY LEVEL
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function returns the gray level of a pixel with the weights used by
+ * grayscale, 0.3 red, 0.6 green and 0.1 blue, rounded, in whole numbers so
+ * the vectorised dither gives exactly the same levels.
+ *
+ * @param[in]  r - red sample.
+ * @param[in]  g - green sample.
+ * @param[in]  b - blue sample.
+ *
+ * @return gray level from 0 to 255.
+ *
+ * @par Example
+ * @verbatim
+   int gray = grayLevel(img.redGray[i][j], img.green[i][j], img.blue[i][j]);
+   @endverbatim
+ *****************************************************************************/
+static int grayLevel(int r, int g, int b)
+{
+    return (3 * r + 6 * g + b + 5) / 10;
+}
+
+//ORDERED DITHER OF A ROW
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function turns one row of a color image into black and white by
+ * comparing the gray level of every pixel with the Bayer threshold of its
+ * column. With SSE2, 16 pixels at a time are converted to gray in 16 bit
+ * lanes, the division by 10 done as a multiply by 6554 keeping the high
+ * half, which is exact for every possible sum, and then compared with the
+ * thresholds.
+ *
+ * @param[in]   r - red row.
+ * @param[in]   g - green row.
+ * @param[in]   b - blue row.
+ * @param[out]  dst - row to write, 0 for black and 255 for white. It may be
+ *                    the red row.
+ * @param[in]   thresholds - 16 thresholds, the Bayer row repeated twice.
+ * @param[in]   count - number of pixels in the row.
+ *
+ * @par Example
+ * @verbatim
+   bayerRow(img.redGray[i], img.green[i], img.blue[i], img.redGray[i],
+       thresholds, img.cols);
+   @endverbatim
+ *****************************************************************************/
+static void bayerRow(const pixel* r, const pixel* g, const pixel* b, pixel* dst,
+    const pixel* thresholds, int count)
+{
+    int j = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i three = _mm_set1_epi16(3);
+    const __m128i six = _mm_set1_epi16(6);
+    const __m128i five = _mm_set1_epi16(5);
+    const __m128i tenth = _mm_set1_epi16(6554);
+    const __m128i limit = _mm_loadu_si128((const __m128i*)thresholds);
+
+    for (; j + 16 <= count; j += 16)
+    {
+        __m128i vr = _mm_loadu_si128((const __m128i*)(r + j));
+        __m128i vg = _mm_loadu_si128((const __m128i*)(g + j));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(
+            _mm_mullo_epi16(_mm_unpacklo_epi8(vr, zero), three),
+            _mm_mullo_epi16(_mm_unpacklo_epi8(vg, zero), six)),
+            _mm_add_epi16(_mm_unpacklo_epi8(vb, zero), five));
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(
+            _mm_mullo_epi16(_mm_unpackhi_epi8(vr, zero), three),
+            _mm_mullo_epi16(_mm_unpackhi_epi8(vg, zero), six)),
+            _mm_add_epi16(_mm_unpackhi_epi8(vb, zero), five));
+
+        __m128i gray = _mm_packus_epi16(_mm_mulhi_epu16(lo, tenth),
+            _mm_mulhi_epu16(hi, tenth));
+
+        //WHITE WHERE GRAY IS ABOVE THE THRESHOLD, SO THE SATURATED DIFFERENCE IS NOT 0
+        __m128i black = _mm_cmpeq_epi8(_mm_subs_epu8(gray, limit), zero);
+
+        _mm_storeu_si128((__m128i*)(dst + j), _mm_andnot_si128(black, _mm_set1_epi8(-1)));
+    }
+#endif
+
+    for (; j < count; j++)
+    {
+        dst[j] = grayLevel(r[j], g[j], b[j]) > thresholds[j % 16] ? 255 : 0;
+    }
+}
+
+//ORDERED DITHER
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function dithers the image with the 8 by 8 Bayer matrix into the
+ * red or gray plane. Every pixel depends on itself only, so the bands of
+ * rows are dithered on separate threads.
+ *
+ * @param[in, out]  img - defined image structure to edit.
+ *
+ * @par Example
+ * @verbatim
+   bayerDither(img);
+   @endverbatim
+ *****************************************************************************/
+static void bayerDither(image& img)
+{
+    parallelBands(img.rows, [&](int, int first, int last)
+    {
+        pixel thresholds[16];
+
+        for (int i = first; i < last; i++)
+        {
+            //THRESHOLDS FROM 2 TO 254, SO BLACK AND WHITE STAY SOLID
+            for (int j = 0; j < 16; j++)
+            {
+                thresholds[j] = pixel(BAYER[i % 8][j % 8] * 4 + 2);
+            }
+
+            bayerRow(img.redGray[i], img.green[i], img.blue[i], img.redGray[i],
+                thresholds, img.cols);
+        }
+    });
+}
+
+//FLOYD STEINBERG DITHER
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function dithers the image by Floyd Steinberg error diffusion into
+ * the red or gray plane. The error of every pixel is passed on, 7/16 to the
+ * right, and 3/16, 5/16 and 1/16 to the pixels below left, below and below
+ * right, all in whole sixteenths so the result does not depend on the
+ * number of threads.
+ *
+ * A pixel can be done once the row above is done two columns further, so
+ * the rows run as a wavefront: the threads take rows in order, and each row
+ * follows the one above it, DITHER_CHUNK columns at a time, a chunk behind.
+ * The rows are taken in order, so the row a thread waits on always belongs
+ * to a thread that is running. The errors for the next row need only two
+ * buffers, as a row cannot overwrite errors the row above has not yet read.
+ *
+ * @param[in, out]  img - defined image structure to edit.
+ *
+ * @par Example
+ * @verbatim
+   floydSteinberg(img);
+   @endverbatim
+ *****************************************************************************/
+static void floydSteinberg(image& img)
+{
+    int rows = img.rows;
+    int cols = img.cols;
+    int workers = min(threadCount(), rows);
+    size_t span = size_t(cols) + 2;
+    vector<int> errors(2 * span, 0);
+    vector<atomic<int>> done(rows);
+    long long held = (long long)(errors.size() * sizeof(int) + done.size() * sizeof(atomic<int>));
+    atomic<int> next(0);
+    taskGroup group;
+    int t;
+
+    trackMemory(held);
+
+    auto work = [&]
+    {
+        int i;
+
+        while ((i = next++) < rows)
+        {
+            const int* in = errors.data() + (i % 2) * span;
+            int* out = errors.data() + ((i + 1) % 2) * span;
+            int carry = 0;
+
+            for (int first = 0; first < cols; first += DITHER_CHUNK)
+            {
+                int last = min(first + DITHER_CHUNK, cols);
+
+                if (i > 0)
+                {
+                    int need = min(last + 1, cols);
+
+                    while (done[i - 1].load(memory_order_acquire) < need)
+                    {
+                        this_thread::yield();
+                    }
+                }
+
+                //ERRORS FROM COLUMN 1 ON ARE FIRST SET BY THE PIXEL ABOVE LEFT
+                if (first == 0)
+                {
+                    out[0] = 0;
+                    out[1] = 0;
+                }
+
+                for (int j = first; j < last; j++)
+                {
+                    int value = grayLevel(img.redGray[i][j], img.green[i][j],
+                        img.blue[i][j]) + ((in[j + 1] + carry + 8) >> 4);
+                    int level = value >= 128 ? 255 : 0;
+                    int error = value - level;
+
+                    img.redGray[i][j] = pixel(level);
+
+                    carry = 7 * error;
+                    out[j] += 3 * error;
+                    out[j + 1] += 5 * error;
+                    out[j + 2] = error;
+                }
+
+                done[i].store(last, memory_order_release);
+            }
+        }
+    };
+
+    for (t = 1; t < workers; t++)
+    {
+        runTask(group, work);
+    }
+
+    work();
+
+    waitTasks(group);
+
+    trackMemory(-held);
+}
+
+//DITHER
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function turns the image into black and white, as for a printer that
+ * can only print black dots, by the method given with --dither: fs for
+ * Floyd Steinberg error diffusion or bayer for ordered dithering. Ascii and
+ * binary output give a P1 or P4 bitmap, and the other output types a gray
+ * image of only black and white.
+ *
+ * @param[in, out]  img - defined image structure to edit.
+ * @param[in]       type - contains type of output file needed.
+ *
+ * @par Example
+ * @verbatim
+   config.ditherMode = "fs";
+   dither(img, "--binary"); //a P4 bitmap
+   @endverbatim
+ *****************************************************************************/
+void dither(image& img, string type)
+{
+    setOutputType(img, type, true);
+
+    if (img.magicNumber == "P2")
+    {
+        img.magicNumber = "P1";
+    }
+    else if (img.magicNumber == "P5")
+    {
+        img.magicNumber = "P4";
+    }
+
+    if (config.ditherMode == "bayer")
+    {
+        bayerDither(img);
+    }
+    else
+    {
+        floydSteinberg(img);
+    }
+}
@@ -0,0 +1,440 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Option codes checked against the golden files, each with the start of
+* the names of its golden files. No option gives the ascii and binary
+* copies of the inputs, whose golden files are named by the output type.
+************************************************************************/
+const char* const GOLDEN_OPTIONS[][2] =
+{
+    { "", "" }, { "--flipX", "flip" }, { "--flipY", "flipY" },
+    { "--rotateCW", "rCW" }, { "--rotateCCW", "rCCW" }, { "--sepia", "sepia" },
+    { "--grayscale", "gray" }
+};
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Output types checked. Ascii and binary output must match the golden
+* files byte for byte. The program's own formats have no golden files, so
+* their output is read back and must hold the pixels of the binary golden
+* file.
+************************************************************************/
+const char* const GOLDEN_TYPES[] = { "--ascii", "--binary", "--planar", "--compressed", "--pam" };
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Input images, the same picture in ascii and in binary, named a and b in
+* the names of the golden files.
+************************************************************************/
+const char* const GOLDEN_INPUTS[] = { "BalloonsA.ppm", "BalloonsB.ppm" };
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Number of times every case is run, the fastest run being its time, and
+* the part of its baseline throughput a case must reach to pass.
+************************************************************************/
+const int GOLDEN_RUNS = 3;
+const double GOLDEN_TOLERANCE = 0.8;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Jobs, each an option code and output type, whose result must be found
+* in the cache when the same job is run again. They are the jobs whose
+* output has an extension of its own.
+************************************************************************/
+const char* const GOLDEN_CACHED[][2] = { { "--dither", "--binary" }, { "", "--yuv" } };
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Names of the row kernel sets, from none to the widest. Every set the
+* processor runs is checked, not only the one the program picks.
+************************************************************************/
+const char* const KERNEL_NAMES[] = { "scalar", "ssse3", "avx2" };
+
+//SAME FILE CONTENTS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function checks whether two files hold exactly the same bytes.
+ *
+ * @param[in]  first - name of the first file.
+ * @param[in]  second - name of the second file.
+ *
+ * @return true if both files can be read and are the same.
+ *
+ * @par Example
+ * @verbatim
+   if (!sameBytes("x.ppm", "test files/sepiabb.ppm"))
+   {
+       cout << "sepiabb differs" << endl;
+   }
+   @endverbatim
+ *****************************************************************************/
+static bool sameBytes(string first, string second)
+{
+    ifstream a(first, ios::binary);
+    ifstream b(second, ios::binary);
+
+    if (!a.is_open() || !b.is_open())
+    {
+        return false;
+    }
+
+    vector<char> one((istreambuf_iterator<char>(a)), istreambuf_iterator<char>());
+    vector<char> two((istreambuf_iterator<char>(b)), istreambuf_iterator<char>());
+
+    return one == two;
+}
+
+//SAME PIXELS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function checks whether two image files, in any format the program
+ * reads, hold the same pixels. Graymaps are read into all three planes, so
+ * a gray image matches the same gray image in another format.
+ *
+ * @param[in]  first - name of the first image.
+ * @param[in]  second - name of the second image.
+ *
+ * @return true if both images can be read and have the same size, alpha
+ *         and pixels.
+ *
+ * @par Example
+ * @verbatim
+   bool same = samePixels("x.tpi", "test files/sepiabb.ppm");
+   @endverbatim
+ *****************************************************************************/
+static bool samePixels(string first, string second)
+{
+    string names[2] = { first, second };
+    image img[2];
+    bool same = true;
+    int i, k;
+
+    for (k = 0; k < 2 && same; k++)
+    {
+        ifstream fin(names[k], ios::binary);
+
+        same = fin.is_open() && readImage(fin, img[k]);
+    }
+
+    same = same && img[0].rows == img[1].rows && img[0].cols == img[1].cols &&
+        (img[0].alpha == nullptr) == (img[1].alpha == nullptr);
+
+    for (i = 0; same && i < img[0].rows; i++)
+    {
+        same = memcmp(img[0].redGray[i], img[1].redGray[i], img[0].cols) == 0 &&
+            memcmp(img[0].green[i], img[1].green[i], img[0].cols) == 0 &&
+            memcmp(img[0].blue[i], img[1].blue[i], img[0].cols) == 0 &&
+            (img[0].alpha == nullptr ||
+            memcmp(img[0].alpha[i], img[1].alpha[i], img[0].cols) == 0);
+    }
+
+    freeimage(img[0]);
+    freeimage(img[1]);
+
+    return same;
+}
+
+//SERVED FROM THE CACHE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function runs a job with a cache in the work directory, and then
+ * asks the cache for the same job, as a second run would before reading
+ * the input. The cache directory is put back afterwards.
+ *
+ * @param[in]  option - option code of the job.
+ * @param[in]  type - contains type of output file needed.
+ * @param[in]  input - name of the input file.
+ * @param[in]  work - directory for the cache and outputs.
+ *
+ * @return true if the second run is answered from the cache with the bytes
+ *         the first run wrote.
+ *
+ * @par Example
+ * @verbatim
+   bool hit = servedFromCache("--dither", "--binary", "BalloonsB.ppm", work);
+   @endverbatim
+ *****************************************************************************/
+static bool servedFromCache(string option, string type, string input, filesystem::path work)
+{
+    string saved = config.cacheDir;
+    string first = (work / "first").string();
+    string second = (work / "second").string();
+    string key = jobKey(option, type, input);
+    string entry;
+    bool served;
+
+    config.cacheDir = (work / "cache").string();
+
+    runJob(option, type, first, input);
+    entry = cacheFind(config.cacheDir, key);
+    served = !entry.empty() && cacheLookup(config.cacheDir, key, second);
+
+    if (served)
+    {
+        string extension = filesystem::path(entry).extension().string();
+
+        served = sameBytes(first + extension, second + extension);
+    }
+
+    config.cacheDir = saved;
+
+    return served;
+}
+
+//READ BASELINE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads a baseline file written by verifyGoldens, a line for
+ * every case with its option code, or none, output type, input image and
+ * throughput in megapixels a second.
+ *
+ * @param[in]   filename - name of the baseline file.
+ * @param[out]  baseline - throughput of every case in the file, by the
+ *                         name of the case.
+ *
+ * @return true if the file exists.
+ *
+ * @par Example
+ * @verbatim
+   map<string, double> baseline;
+   readBaseline("goldens.txt", baseline);
+   double fastest = baseline["--sepia --binary BalloonsB.ppm"];
+   @endverbatim
+ *****************************************************************************/
+static bool readBaseline(string filename, map<string, double>& baseline)
+{
+    ifstream fin(filename);
+    string option, type, input;
+    double speed;
+
+    if (!fin.is_open())
+    {
+        return false;
+    }
+
+    while (fin >> option >> type >> input >> speed)
+    {
+        baseline[(option == "none" ? "" : option + " ") + type + " " + input] = speed;
+    }
+
+    return true;
+}
+
+//VERIFY GOLDEN FILES
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function runs every option code with a golden file on both input
+ * images and to every output type, through the same path as a job given
+ * on the command line, and checks the results against the golden files in
+ * the directory. It also times every case, the fastest of GOLDEN_RUNS
+ * runs, and prints its throughput in megapixels a second.
+ *
+ * When a baseline file is given and exists, a case also fails if its
+ * throughput falls below GOLDEN_TOLERANCE of the baseline. When it is
+ * given and does not exist, the throughputs of this run are written to it,
+ * to be the baseline of later runs. Delete the file to take a new one.
+ *
+ * Then the row kernels of every instruction set the processor has are
+ * checked against a plain reversal, and last, every job of GOLDEN_CACHED
+ * is run with a cache, and the cache must answer the same job again with
+ * the same result.
+ *
+ * The outputs and cache are written to a folder in the temporary directory,
+ * which is removed at the end.
+ *
+ * @param[in]  dir - directory of the input images and golden files.
+ * @param[in]  baselineFile - name of the baseline file, or empty for none.
+ *
+ * @return 0 if every case passed, 1 if any failed.
+ *
+ * @par Example
+ * @verbatim
+   int status = verifyGoldens("test files", "goldens.txt");
+   //prints
+   //Case                                     Result      MP/s  Baseline
+   //--sepia --binary BalloonsB.ppm           ok         48.21     47.90
+   //...
+   //row kernels avx2                         ok
+   //cache --dither --binary BalloonsB.ppm    ok
+   //cache --yuv BalloonsB.ppm                ok
+   //75 of 75 cases passed
+   @endverbatim
+ *****************************************************************************/
+int verifyGoldens(string dir, string baselineFile)
+{
+    map<string, double> baseline;
+    bool haveBaseline = !baselineFile.empty() && readBaseline(baselineFile, baseline);
+    ostringstream record;
+    filesystem::path work = filesystem::temp_directory_path() /
+        ("thpe11_goldens_" + to_string(chrono::steady_clock::now().time_since_epoch().count()));
+    int cases = 0;
+    int passed = 0;
+
+    filesystem::create_directories(work);
+
+    cout << left << setw(41) << "Case" << setw(8) << "Result" << right << setw(10)
+        << "MP/s" << setw(10) << "Baseline" << endl;
+
+    for (const char* const* option : GOLDEN_OPTIONS)
+    {
+        for (const char* type : GOLDEN_TYPES)
+        {
+            for (int k = 0; k < 2; k++)
+            {
+                string input = dir + "/" + GOLDEN_INPUTS[k];
+                string out = string(type) == "--ascii" ? "a" : "b";
+                string stem = option[1][0] != '\0' ? option[1] : out == "a" ? "ascii" : "binary";
+                string golden = dir + "/" + stem + (option[1][0] != '\0' ? out : "") +
+                    (k == 0 ? "a" : "b") + (string(option[1]) == "gray" ? ".pgm" : ".ppm");
+                string name = (option[0][0] != '\0' ? string(option[0]) + " " : "") + type +
+                    " " + GOLDEN_INPUTS[k];
+                string written;
+                double fastest = 0;
+                image img;
+                ifstream fin;
+                int maxval;
+                bool ok;
+
+                fin.open(input, ios::binary);
+
+                if (!fin.is_open() || !readHeader(fin, img, maxval))
+                {
+                    cout << "Unable to read the image: " << input << endl;
+                    filesystem::remove_all(work);
+                    return 1;
+                }
+
+                fin.close();
+
+                for (int run = 0; run < GOLDEN_RUNS; run++)
+                {
+                    auto started = chrono::steady_clock::now();
+
+                    written = processFrames(option[0], type, (work / "out").string(), input);
+
+                    double seconds = chrono::duration<double>(chrono::steady_clock::now() -
+                        started).count();
+
+                    fastest = run == 0 ? seconds : min(fastest, seconds);
+                }
+
+                if (out == "a" || string(type) == "--binary")
+                {
+                    ok = sameBytes(written, golden);
+                }
+                else
+                {
+                    ok = samePixels(written, golden);
+                }
+
+                double speed = (double)img.rows * img.cols / max(fastest, 1e-9) / 1e6;
+                auto found = baseline.find(name);
+                bool slow = haveBaseline && found != baseline.end() &&
+                    speed < found->second * GOLDEN_TOLERANCE;
+
+                cout << left << setw(41) << name << setw(8)
+                    << (!ok ? "DIFFERS" : slow ? "SLOW" : "ok") << right << fixed
+                    << setprecision(2) << setw(10) << speed;
+
+                if (found != baseline.end())
+                {
+                    cout << setw(10) << found->second;
+                }
+
+                cout << endl;
+                cout.unsetf(ios::fixed);
+
+                record << (option[0][0] != '\0' ? option[0] : "none") << " " << type << " "
+                    << GOLDEN_INPUTS[k] << " " << fixed << setprecision(2) << speed << endl;
+
+                cases++;
+
+                if (ok && !slow)
+                {
+                    passed++;
+                }
+
+                filesystem::remove(written);
+            }
+        }
+    }
+
+    //EVERY KERNEL SET MUST MIRROR A ROW THE SAME WAY
+    for (int kernels = 0; kernels <= rowKernels(); kernels++)
+    {
+        bool ok = checkRowKernels(kernels);
+
+        cout << left << setw(41) << string("row kernels ") + KERNEL_NAMES[kernels]
+            << (ok ? "ok" : "DIFFERS") << right << endl;
+
+        cases++;
+
+        if (ok)
+        {
+            passed++;
+        }
+    }
+
+    //A RESULT STORED IN THE CACHE MUST BE FOUND BY THE NEXT RUN
+    for (const char* const* job : GOLDEN_CACHED)
+    {
+        string ditherMode = config.ditherMode;
+        string name = string("cache ") + (job[0][0] != '\0' ? string(job[0]) + " " : "") +
+            job[1] + " " + GOLDEN_INPUTS[1];
+        bool ok;
+
+        config.ditherMode = "fs";
+        ok = servedFromCache(job[0], job[1], dir + "/" + GOLDEN_INPUTS[1], work);
+        config.ditherMode = ditherMode;
+
+        cout << left << setw(41) << name << (ok ? "ok" : "MISSED") << right << endl;
+
+        cases++;
+
+        if (ok)
+        {
+            passed++;
+        }
+    }
+
+    filesystem::remove_all(work);
+
+    cout << passed << " of " << cases << " cases passed" << endl;
+
+    if (!baselineFile.empty() && !haveBaseline)
+    {
+        ofstream fout(baselineFile);
+
+        fout << record.str();
+        cout << "Baseline written to " << baselineFile << endl;
+    }
+
+    return passed == cases ? 0 : 1;
+}
@@ -36,7 +36,9 @@ void openIPFile(ifstream& file, string filename)
  * @author Steve Nathan de Sa
  *
  * @par Description
- * This function opens output image file in binary format.
+ * This function opens output image file in binary format. An existing file
+ * is removed first rather than truncated, so a file that shares its data
+ * with a result in the cache through a hard link is never written over.
  *
  * @param[in, out]  file - ifstream file declaration to edit file.
  * @param[in]       filename - contains name of file to be opened.
@@ -50,135 +52,1512 @@ void openIPFile(ifstream& file, string filename)
  *****************************************************************************/
 void openOPFile(ofstream& file, string filename)
 {
+    remove(filename.c_str());
+
     file.open(filename, ios::binary | ios::trunc);
 
-    if (!file.is_open())
+    if (!file.is_open())
+    {
+        cout << "Unable to open the file: " << filename << endl;
+        exit(0);
+    }
+}
+
+//OPEN INPUT FILE OR STANDARD INPUT
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function opens the input of the program and returns the stream buffer
+ * to read it from. The name "-" stands for standard input, which is switched
+ * to binary mode, so the program can sit in a shell pipeline. Any other name
+ * is opened as a file with openIPFile.
+ *
+ * @param[in, out]  file - ifstream file declaration to edit file.
+ * @param[in]       filename - contains name of file to be opened, or "-".
+ *
+ * @return the stream buffer to read the input from.
+ *
+ * @par Example
+ * @verbatim
+   ifstream fin;
+   prefetchBuf ahead(openInput(fin, "-")); //reads what is piped in
+   istream in(&ahead);
+   @endverbatim
+ *****************************************************************************/
+streambuf* openInput(ifstream& file, string filename)
+{
+    if (filename == "-")
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        return cin.rdbuf();
+    }
+
+    openIPFile(file, filename);
+
+    return file.rdbuf();
+}
+
+//OPEN OUTPUT FILE OR STANDARD OUTPUT
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function opens the output of the program and returns the stream
+ * buffer to write it to. The name "-" stands for standard output, which is
+ * switched to binary mode. Messages the program prints to cout from then on
+ * are sent to standard error instead, so they cannot end up inside the image
+ * data. Any other name is opened as a file with openOPFile.
+ *
+ * @param[in, out]  file - ofstream file declaration to edit file.
+ * @param[in]       filename - contains name of file to be opened, or "-".
+ *
+ * @return the stream buffer to write the output to.
+ *
+ * @par Example
+ * @verbatim
+   ofstream fout;
+   writeBehindBuf behind(openOutput(fout, "-")); //writes into the pipe
+   ostream out(&behind);
+   @endverbatim
+ *****************************************************************************/
+streambuf* openOutput(ofstream& file, string filename)
+{
+    if (filename == "-")
+    {
+        streambuf* stdoutBuf = cout.rdbuf();
+
+#ifdef _WIN32
+        cout.flush();
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        cout.rdbuf(cerr.rdbuf());
+
+        return stdoutBuf;
+    }
+
+    openOPFile(file, filename);
+
+    return file.rdbuf();
+}
+
+//SKIP HEADER WHITESPACE AND COMMENTS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function skips the whitespace and comments in front of the next
+ * header token. A comment runs from a '#' to the end of its line and may
+ * appear anywhere in the header. Every comment is added to the image comment,
+ * one comment per line, so it can be written back out.
+ *
+ * @param[in, out]  in - stream buffer positioned inside the header.
+ * @param[in, out]  img - defined image structure to store comments in.
+ *
+ * @return the next character, or end of file.
+ *
+ * @par Example
+ * @verbatim
+   //in holds "  # made by hand\n735 486"
+   int c = headerSkip(fin.rdbuf(), img); //c is '7'
+   @endverbatim
+ *****************************************************************************/
+static int headerSkip(streambuf* in, image& img)
+{
+    int c = in->sgetc();
+
+    while (c != EOF)
+    {
+        if (c == '#')
+        {
+            if (!img.comment.empty())
+            {
+                img.comment += '\n';
+            }
+
+            while (c != EOF && c != '\n' && c != '\r')
+            {
+                img.comment += char(c);
+                c = in->snextc();
+            }
+        }
+        else if (isspace(c))
+        {
+            c = in->snextc();
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return c;
+}
+
+//READ HEADER NUMBER
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads one unsigned decimal header value, such as the width,
+ * digit by digit straight from the stream buffer without building a string.
+ * The value must be followed by whitespace or a comment.
+ *
+ * @param[in, out]  in - stream buffer positioned inside the header.
+ * @param[in, out]  img - defined image structure to store comments in.
+ * @param[out]      value - the number read.
+ *
+ * @return true if a valid number no larger than 999999999 was read.
+ *
+ * @par Example
+ * @verbatim
+   int cols;
+   if (headerNumber(fin.rdbuf(), img, cols))
+   {
+       cout << "Width: " << cols;
+   }
+   @endverbatim
+ *****************************************************************************/
+static bool headerNumber(streambuf* in, image& img, int& value)
+{
+    int digits = 0;
+    int c = headerSkip(in, img);
+
+    value = 0;
+
+    while (c >= '0' && c <= '9')
+    {
+        if (digits == 9)
+        {
+            return false;
+        }
+
+        value = value * 10 + (c - '0');
+        digits++;
+        c = in->snextc();
+    }
+
+    return digits > 0 && (c == '#' || isspace(c));
+}
+
+//READ HEADER WORD
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads the next word of a PAM header, skipping whitespace
+ * and comments in front of it.
+ *
+ * @param[in, out]  in - stream buffer positioned in the header.
+ * @param[in, out]  img - defined image structure to add comments to.
+ * @param[out]      word - the word read.
+ *
+ * @return true if a word was read.
+ *
+ * @par Example
+ * @verbatim
+   string word;
+   headerWord(fin.rdbuf(), img, word); //word is "WIDTH"
+   @endverbatim
+ *****************************************************************************/
+static bool headerWord(streambuf* in, image& img, string& word)
+{
+    int c = headerSkip(in, img);
+
+    word.clear();
+
+    while (c != EOF && !isspace(c))
+    {
+        word += char(c);
+        c = in->snextc();
+    }
+
+    return !word.empty();
+}
+
+//READ PAM HEADER
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads the fields of a PAM header, which follow the magic
+ * number P7 as lines of a name and a value, ending with ENDHDR and a
+ * newline. The tuple type is read but not needed, as the depth tells what
+ * the channels are: 1 gray, 2 gray and alpha, 3 red, green and blue, and 4
+ * red, green, blue and alpha.
+ *
+ * @param[in, out]  in - stream buffer positioned after the magic number.
+ * @param[in, out]  img - defined image structure to store the size in.
+ * @param[out]      maxval - maximum value of a sample.
+ * @param[out]      depth - number of channels.
+ *
+ * @return true if the header is complete.
+ *
+ * @par Example
+ * @verbatim
+   int maxval, depth;
+   if (pamHeader(fin.rdbuf(), img, maxval, depth) && depth == 4)
+   {
+       cout << "Image has alpha";
+   }
+   @endverbatim
+ *****************************************************************************/
+static bool pamHeader(streambuf* in, image& img, int& maxval, int& depth)
+{
+    string word;
+    string tupleType;
+    bool valid = true;
+
+    img.cols = 0;
+    img.rows = 0;
+    maxval = 0;
+    depth = 0;
+
+    while (valid && headerWord(in, img, word) && word != "ENDHDR")
+    {
+        if (word == "WIDTH")
+        {
+            valid = headerNumber(in, img, img.cols);
+        }
+        else if (word == "HEIGHT")
+        {
+            valid = headerNumber(in, img, img.rows);
+        }
+        else if (word == "DEPTH")
+        {
+            valid = headerNumber(in, img, depth);
+        }
+        else if (word == "MAXVAL")
+        {
+            valid = headerNumber(in, img, maxval);
+        }
+        else if (word == "TUPLTYPE")
+        {
+            valid = headerWord(in, img, tupleType);
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+
+    //ENDHDR ENDS ITS LINE, THE DATA STARTS ON THE NEXT
+    if (!valid || word != "ENDHDR" || in->sbumpc() != '\n')
+    {
+        return false;
+    }
+
+    return depth >= 1 && depth <= 4;
+}
+
+//READ IMAGE HEADER
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads the header of any netPBM image, P1 to P7, in a single
+ * pass over the stream. Whitespace and comments may appear anywhere between
+ * the header values, as the format allows. The width and height are checked
+ * before anything is assigned, and the stream is left at the first byte of
+ * the pixel data.
+ *
+ * Only a single whitespace character may follow the last header value, so a
+ * comment on the same line, such as "255 #x", is not supported. In a text
+ * image the comment is refused. In a binary image the byte after the
+ * whitespace is the first pixel byte, even if it is a #, as the format
+ * says, so the comment is read as pixel data.
+ *
+ * @param[in, out]  fin - stream to read the header from.
+ * @param[in, out]  img - defined image structure to store the magic number,
+ *                        comment, rows and columns in.
+ * @param[out]      maxval - largest sample value, 1 for P1 and P4 images.
+ * @param[out]      depth - if given, number of channels: 1 for bitmaps and
+ *                          graymaps, 3 for pixmaps and up to 4 for PAM.
+ *
+ * @return true if the header is valid and the image is not too large.
+ *
+ * @par Example
+ * @verbatim
+   int maxval;
+   if (readHeader(fin, img, maxval))
+   {
+       cout << img.cols << " by " << img.rows;
+   }
+   @endverbatim
+ *****************************************************************************/
+bool readHeader(istream& fin, image& img, int& maxval, int* depth)
+{
+    streambuf* in = fin.rdbuf();
+    int c;
+
+    img.comment.clear();
+    img.magicNumber.clear();
+
+    if (in->sbumpc() != 'P')
+    {
+        return false;
+    }
+
+    c = in->sbumpc();
+
+    if (c < '1' || c > '7')
+    {
+        return false;
+    }
+
+    img.magicNumber = "P";
+    img.magicNumber += char(c);
+
+    c = in->sgetc();
+
+    if (c != '#' && !isspace(c))
+    {
+        return false;
+    }
+
+    if (img.magicNumber == "P7")
+    {
+        int channels;
+
+        if (!pamHeader(in, img, maxval, channels))
+        {
+            return false;
+        }
+
+        if (depth != nullptr)
+        {
+            *depth = channels;
+        }
+    }
+    else
+    {
+        if (!headerNumber(in, img, img.cols) || !headerNumber(in, img, img.rows))
+        {
+            return false;
+        }
+
+        maxval = 1;
+
+        if (img.magicNumber != "P1" && img.magicNumber != "P4")
+        {
+            if (!headerNumber(in, img, maxval))
+            {
+                return false;
+            }
+        }
+
+        //COMMENTS MAY NOT FOLLOW THE LAST HEADER VALUE
+        if (in->sgetc() == '#')
+        {
+            return false;
+        }
+
+        //A SINGLE WHITESPACE CHARACTER SEPARATES THE HEADER FROM THE DATA
+        in->sbumpc();
+
+        //NO TEXT SAMPLE STARTS WITH #, SO A COMMENT AFTER THE SEPARATOR IS REFUSED
+        if (in->sgetc() == '#' && (img.magicNumber == "P1" || img.magicNumber == "P2" ||
+            img.magicNumber == "P3"))
+        {
+            return false;
+        }
+
+        if (depth != nullptr)
+        {
+            *depth = img.magicNumber == "P3" || img.magicNumber == "P6" ? 3 : 1;
+        }
+    }
+
+    if (img.cols <= 0 || img.rows <= 0 || maxval <= 0 || maxval > 65535)
+    {
+        return false;
+    }
+
+    if ((long long)img.rows * img.cols > MAX_IMAGE_PIXELS)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+//ASCII DATA CHARACTER
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function tells whether a character can be part of the pixel data of
+ * an ascii image, which holds only digits and whitespace.
+ *
+ * @param[in]  c - character to check.
+ *
+ * @return true for a digit or whitespace.
+ *
+ * @par Example
+ * @verbatim
+   asciiData('7'); //true
+   asciiData('P'); //false, the next image starts here
+   @endverbatim
+ *****************************************************************************/
+static bool asciiData(char c)
+{
+    return (c >= '0' && c <= '9') || isspace((unsigned char)c);
+}
+
+//GATHER ASCII PIXEL DATA
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function copies the pixel data of an ascii image out of a stream, up
+ * to the first character that is neither a digit nor whitespace, which is
+ * where a comment or the next image of the stream starts. A prefetch buffer
+ * is scanned a chunk at a time in place, any other stream a character at a
+ * time.
+ *
+ * @param[in, out]  fin - stream positioned at the pixel data.
+ * @param[out]      data - the pixel data.
+ *
+ * @par Example
+ * @verbatim
+   vector<char> data;
+   gatherASCII(fin, data); //data holds "255 0 0\n0 255 0\n..."
+   @endverbatim
+ *****************************************************************************/
+static void gatherASCII(istream& fin, vector<char>& data)
+{
+    streambuf* in = fin.rdbuf();
+    prefetchBuf* ahead = dynamic_cast<prefetchBuf*>(in);
+
+    if (ahead == nullptr)
+    {
+        int c = in->sgetc();
+
+        while (c != EOF && asciiData(char(c)))
+        {
+            data.push_back(char(c));
+            c = in->snextc();
+        }
+
+        return;
+    }
+
+    while (true)
+    {
+        const char* chunk;
+        size_t length = ahead->peek(chunk);
+        size_t n = 0;
+
+        while (n < length && asciiData(chunk[n]))
+        {
+            n++;
+        }
+
+        data.insert(data.end(), chunk, chunk + n);
+        ahead->consume(n);
+
+        if (n < length || length == 0)
+        {
+            return;
+        }
+    }
+}
+
+//DECODE ASCII PIXEL DATA
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads the pixel data of a P3 image into its planes, or of a P2
+ * image into its first plane, using every thread. The data is first gathered
+ * from the stream, then split into one piece per thread, each piece ending at
+ * whitespace so no number is cut in two. The threads count the numbers in
+ * their pieces, the counts are added up to give every piece the index of its
+ * first number, and then the threads convert their pieces straight into the
+ * planes. Numbers past the end of the image are ignored. When stats is
+ * given, every piece also counts the samples it converts into histograms
+ * of its own, which are merged at the end.
+ *
+ * @param[in, out]  fin - stream positioned at the pixel data.
+ * @param[in, out]  img - defined image structure with its planes assigned.
+ * @param[in]       channels - samples per pixel, 3 for P3 and 1 for P2.
+ * @param[in, out]  stats - cleared statistics to count the samples into,
+ *                          by plane, or nullptr to skip them.
+ *
+ * @return true if the data held a number for every sample of the image.
+ *
+ * @par Example
+ * @verbatim
+   if (readHeader(fin, img, maxval) && img.magicNumber == "P3")
+   {
+       resizeimage(img, oldRows, oldCols);
+       decodeASCII(fin, img, 3, nullptr);
+   }
+   @endverbatim
+ *****************************************************************************/
+static bool decodeASCII(istream& fin, image& img, int channels, imageStats* stats)
+{
+    int k;
+    int pieces = threadCount();
+    long long total = 0;
+    long long inputs = (long long)channels * img.rows * img.cols;
+    vector<char> data;
+    vector<size_t> bounds(pieces + 1);
+    vector<long long> counts(pieces);
+    vector<imageStats> partial(stats != nullptr ? pieces : 0);
+
+    data.reserve(size_t(inputs) * 2);
+    gatherASCII(fin, data);
+    trackMemory((long long)data.capacity());
+
+    //EVERY PIECE ENDS AT WHITESPACE OR AT THE END OF THE DATA
+    bounds[0] = 0;
+
+    for (k = 1; k <= pieces; k++)
+    {
+        size_t b = max(bounds[k - 1], data.size() * k / pieces);
+
+        while (b < data.size() && !isspace((unsigned char)data[b]))
+        {
+            b++;
+        }
+
+        bounds[k] = b;
+    }
+
+    parallelBands(pieces, [&](int, int first, int last)
+    {
+        int piece;
+
+        for (piece = first; piece < last; piece++)
+        {
+            long long count = 0;
+            bool inside = false;
+            size_t i;
+
+            for (i = bounds[piece]; i < bounds[piece + 1]; i++)
+            {
+                bool digit = data[i] >= '0' && data[i] <= '9';
+
+                count += digit && !inside;
+                inside = digit;
+            }
+
+            counts[piece] = count;
+        }
+    });
+
+    for (k = 0; k < pieces; k++)
+    {
+        long long count = counts[k];
+
+        counts[k] = total;
+        total += count;
+    }
+
+    if (total < inputs)
+    {
+        trackMemory(-(long long)data.capacity());
+        return false;
+    }
+
+    parallelBands(pieces, [&](int, int first, int last)
+    {
+        int piece;
+
+        for (piece = first; piece < last; piece++)
+        {
+            long long index = counts[piece];
+            long long sample = index / channels;
+            int row = int(sample / img.cols);
+            int col = int(sample % img.cols);
+            int plane = int(index % channels);
+            pixel** planes[3] = { img.redGray, img.green, img.blue };
+            imageStats* local = stats != nullptr ? &partial[piece] : nullptr;
+            size_t i = bounds[piece];
+            size_t end = bounds[piece + 1];
+
+            if (local != nullptr)
+            {
+                clearStats(*local);
+            }
+
+            while (index < inputs)
+            {
+                int value = 0;
+
+                while (i < end && (data[i] < '0' || data[i] > '9'))
+                {
+                    i++;
+                }
+
+                if (i == end)
+                {
+                    break;
+                }
+
+                //LONGER NUMBERS THAN ANY SAMPLE ONLY NEED TO STAY LARGE
+                while (i < end && data[i] >= '0' && data[i] <= '9')
+                {
+                    value = min(value * 10 + (data[i] - '0'), 99999);
+                    i++;
+                }
+
+                planes[plane][row][col] = pixel(value);
+                index++;
+
+                if (local != nullptr)
+                {
+                    local->histogram[plane][pixel(value)]++;
+                }
+
+                if (++plane == channels)
+                {
+                    plane = 0;
+
+                    if (++col == img.cols)
+                    {
+                        col = 0;
+                        row++;
+                    }
+                }
+            }
+        }
+    });
+
+    trackMemory(-(long long)data.capacity());
+
+    for (k = 0; k < int(partial.size()); k++)
+    {
+        mergeStats(*stats, partial[k]);
+    }
+
+    if (stats != nullptr)
+    {
+        stats->count = (long long)img.rows * img.cols;
+    }
+
+    return true;
+}
+
+//DECODE ASCII PIXEL DATA IN PLACE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads the pixel data of a P3 or P2 image into its planes one
+ * number at a time, straight from the stream. It is slower than decodeASCII
+ * but needs no memory besides the planes, so it is used when a memory limit
+ * is set that the text of the image would not fit in. The stream is left at
+ * the character after the last number.
+ *
+ * @param[in, out]  fin - stream positioned at the pixel data.
+ * @param[in, out]  img - defined image structure with its planes assigned.
+ * @param[in]       channels - samples per pixel, 3 for P3 and 1 for P2.
+ * @param[in, out]  stats - cleared statistics to count the samples into,
+ *                          by plane, or nullptr to skip them.
+ *
+ * @return true if the data held a number for every sample of the image.
+ *
+ * @par Example
+ * @verbatim
+   if (config.plan.sequentialDecode)
+   {
+       decodeASCIIStream(fin, img, 3, nullptr);
+   }
+   @endverbatim
+ *****************************************************************************/
+static bool decodeASCIIStream(istream& fin, image& img, int channels, imageStats* stats)
+{
+    streambuf* in = fin.rdbuf();
+    pixel** planes[3] = { img.redGray, img.green, img.blue };
+    int c = in->sgetc();
+    int i, j, p;
+
+    for (i = 0; i < img.rows; i++)
+    {
+        for (j = 0; j < img.cols; j++)
+        {
+            for (p = 0; p < channels; p++)
+            {
+                int value = 0;
+
+                while (c != EOF && isspace(c))
+                {
+                    c = in->snextc();
+                }
+
+                if (c < '0' || c > '9')
+                {
+                    return false;
+                }
+
+                while (c >= '0' && c <= '9')
+                {
+                    value = min(value * 10 + (c - '0'), 99999);
+                    c = in->snextc();
+                }
+
+                planes[p][i][j] = pixel(value);
+
+                if (stats != nullptr)
+                {
+                    stats->histogram[p][pixel(value)]++;
+                }
+            }
+        }
+    }
+
+    if (stats != nullptr)
+    {
+        stats->count = (long long)img.rows * img.cols;
+    }
+
+    return true;
+}
+
+//READ IMAGE FILE WITH PREFETCH
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads an image from an opened file and closes the file. The
+ * file is read ahead in chunks on a second thread while the data already
+ * read is being decoded, so the decoder rarely waits on the disk.
+ *
+ * @param[in, out]  fin - ifstream file declaration to edit file.
+ * @param[in, out]  img - defined image structure to store data in.
+ * @param[out]      stats - statistics to fill, or nullptr to skip them.
+ *
+ * @return true if the function successfully reads the file data.
+ *
+ * @par Example
+ * @verbatim
+   ifstream fin;
+   image img;
+   openIPFile(fin, "steve.ppm");
+   if (readImage(fin, img))
+   {
+        cout << "File has been successfully read";
+   }
+   @endverbatim
+ *****************************************************************************/
+bool readImage(ifstream& fin, image& img, imageStats* stats)
+{
+    bool success;
+
+    {
+        prefetchBuf ahead(fin.rdbuf());
+        istream in(&ahead);
+
+        success = readImage(in, img, stats);
+    }
+
+    fin.close();
+
+    return success;
+}
+
+//READ DATA FROM IMAGE FILE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads the data from the stream according to the file type as
+ * specified by the magic number. The data is stored in the structure image 
+ * for use later on in the code for editting and printing out.
+ *
+ * The stream is left just past the pixel data, so a following frame of a
+ * multi image stream can be read by calling the function again. Planes
+ * already assigned to img are reused when the new frame has the same size.
+ *
+ * Graymaps, P2 and P5, are read into all three planes, so every operation
+ * works on them as on a gray color image.
+ *
+ * When stats is given, the per channel histograms of the image are counted
+ * while the pixels are decoded, so no second pass over the image is needed,
+ * except for planar images, whose planes are counted in a second pass once
+ * they have been read.
+ *
+ * @param[in, out]  fin - stream to read the image from.
+ * @param[in, out]  img - defined image structure to store data in.
+ * @param[out]      stats - statistics to fill, or nullptr to skip them.
+ *
+ * @return true if the function successfully reads the file data.
+ * 
+ * @par Example
+ * @verbatim
+   ifstream fin;
+   string filename = "steve.txt";
+   openIPFile(fin,filename); //opens file named steve.txt
+   image img; //structure
+   if(readImage(fin, img)
+   {
+        cout << "File has been successfully read";
+   }
+   @endverbatim
+ *****************************************************************************/
+bool readImage(istream& fin, image& img, imageStats* stats)
+{
+    int maxval;
+    int oldRows = img.rows;
+    int oldCols = img.cols;
+
+    //PLANAR IMAGES START WITH T INSTEAD OF P
+    if (fin.rdbuf()->sgetc() == 'T')
+    {
+        //PLANAR IMAGES HAVE NO ALPHA CHANNEL
+        freearray(img.alpha, img.rows);
+
+        nextStage("header", "decode");
+
+        if (!readPlanar(fin, img))
+        {
+            return false;
+        }
+
+        if (stats != nullptr)
+        {
+            computeStats(img, *stats);
+        }
+
+        return true;
+    }
+
+    int depth;
+
+    if (!readHeader(fin, img, maxval, &depth) || maxval > 255)
+    {
+        return false;
+    }
+
+    if (img.magicNumber != "P2" && img.magicNumber != "P3" && img.magicNumber != "P5" &&
+        img.magicNumber != "P6" && img.magicNumber != "P7")
+    {
+        return false;
+    }
+
+    //THE INPUT OF THE JOB, NOT AN IMAGE READ BY AN OPERATION
+    nextStage("header", "decode");
+
+    int i, j, first;
+    bool hasAlpha = img.magicNumber == "P7" && depth % 2 == 0;
+
+    resizeimage(img, oldRows, oldCols);
+
+    if (!hasAlpha)
+    {
+        freearray(img.alpha, img.rows);
+    }
+    else if (img.alpha == nullptr)
+    {
+        allocarray(img.alpha, img.rows, img.cols);
+    }
+
+    if (stats != nullptr)
+    {
+        clearStats(*stats);
+    }
+
+    if (img.magicNumber == "P2" || img.magicNumber == "P3") //PGM AND PPM ASCII
+    {
+        bool decoded = config.plan.sequentialDecode ?
+            decodeASCIIStream(fin, img, depth, stats) : decodeASCII(fin, img, depth, stats);
+
+        if (!decoded)
+        {
+            return false;
+        }
+
+        if (depth == 1)
+        {
+            parallelBands(img.rows, [&](int, int first, int last)
+            {
+                for (int row = first; row < last; row++)
+                {
+                    memcpy(img.green[row], img.redGray[row], img.cols);
+                    memcpy(img.blue[row], img.redGray[row], img.cols);
+                }
+            });
+        }
+
+        if (stats != nullptr)
+        {
+            //A GRAY SAMPLE IS IN ALL THREE PLANES, SO IT COUNTS FOR EVERY CHANNEL
+            if (depth == 1)
+            {
+                memcpy(stats->histogram[1], stats->histogram[0], sizeof(stats->histogram[0]));
+                memcpy(stats->histogram[2], stats->histogram[0], sizeof(stats->histogram[0]));
+            }
+
+            finishStats(*stats);
+        }
+
+        return true;
+    }
+
+    else if (img.magicNumber == "P6") //PPM BINARY
+    {
+        //A BLOCK OF ROWS AT A TIME, SO NO COPY OF THE WHOLE IMAGE IS HELD
+        size_t rowBytes = size_t(img.cols) * 3;
+        int blockRows = int(max(size_t(1), IO_CHUNK_SIZE / rowBytes));
+        vector<pixel> block(rowBytes * blockRows);
+
+        trackMemory((long long)block.size());
+
+        for (first = 0; first < img.rows; first += blockRows)
+        {
+            int count = min(blockRows, img.rows - first);
+            pixel* bvalues = block.data();
+
+            if (!fin.read((char*)bvalues, streamsize(rowBytes * count)))
+            {
+                trackMemory(-(long long)block.size());
+                return false;
+            }
+
+            for (i = first; i < first + count; i++)
+            {
+                for (j = 0; j < img.cols; j++)
+                {
+                    img.redGray[i][j] = *bvalues++;
+                    img.green[i][j] = *bvalues++;
+                    img.blue[i][j] = *bvalues++;
+
+                    if (stats != nullptr)
+                    {
+                        stats->histogram[0][img.redGray[i][j]]++;
+                        stats->histogram[1][img.green[i][j]]++;
+                        stats->histogram[2][img.blue[i][j]]++;
+                    }
+                }
+            }
+        }
+
+        trackMemory(-(long long)block.size());
+
+        if (stats != nullptr)
+        {
+            stats->count = (long long)img.rows * img.cols;
+            finishStats(*stats);
+        }
+
+        return true;
+    }
+
+    else if (img.magicNumber == "P5" || img.magicNumber == "P7") //PGM BINARY AND PAM
+    {
+        //GRAY CHANNELS ARE COPIED TO ALL THREE PLANES, ALPHA IS ALWAYS LAST
+        size_t rowBytes = size_t(img.cols) * depth;
+        int blockRows = int(max(size_t(1), IO_CHUNK_SIZE / rowBytes));
+        int green = depth < 3 ? 0 : 1;
+        int blue = depth < 3 ? 0 : 2;
+        vector<pixel> block(rowBytes * blockRows);
+
+        trackMemory((long long)block.size());
+
+        for (first = 0; first < img.rows; first += blockRows)
+        {
+            int count = min(blockRows, img.rows - first);
+
+            if (!fin.read((char*)block.data(), streamsize(rowBytes * count)))
+            {
+                trackMemory(-(long long)block.size());
+                return false;
+            }
+
+            for (i = first; i < first + count; i++)
+            {
+                const pixel* bvalues = block.data() + (i - first) * rowBytes;
+
+                for (j = 0; j < img.cols; j++, bvalues += depth)
+                {
+                    img.redGray[i][j] = bvalues[0];
+                    img.green[i][j] = bvalues[green];
+                    img.blue[i][j] = bvalues[blue];
+
+                    if (hasAlpha)
+                    {
+                        img.alpha[i][j] = bvalues[depth - 1];
+                    }
+
+                    if (stats != nullptr)
+                    {
+                        stats->histogram[0][bvalues[0]]++;
+                        stats->histogram[1][bvalues[green]]++;
+                        stats->histogram[2][bvalues[blue]]++;
+                    }
+                }
+            }
+        }
+
+        trackMemory(-(long long)block.size());
+
+        if (stats != nullptr)
+        {
+            stats->count = (long long)img.rows * img.cols;
+            finishStats(*stats);
+        }
+
+        return true;
+    }
+
+    return true;
+}
+
+//NEXT FRAME
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function checks whether another image follows in a multi image
+ * stream. netPBM allows any number of images back to back in one file, such
+ * as the frames of a video. Whitespace between the images is skipped, as are
+ * comments, which some programs leave after the last image.
+ *
+ * @param[in, out]  fin - stream positioned just past an image.
+ *
+ * @return true if there is more data to read as another image.
+ *
+ * @par Example
+ * @verbatim
+   do
+   {
+       readImage(fin, img);
+       //process and write img
+   } while (nextFrame(fin));
+   @endverbatim
+ *****************************************************************************/
+bool nextFrame(istream& fin)
+{
+    streambuf* in = fin.rdbuf();
+    int c = in->sgetc();
+
+    while (c != EOF && (isspace(c) || c == '#'))
+    {
+        if (c == '#')
+        {
+            while (c != EOF && c != '\n')
+            {
+                c = in->snextc();
+            }
+        }
+        else
+        {
+            c = in->snextc();
+        }
+    }
+
+    return c != EOF;
+}
+
+//OUTPUT FILE NAME
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function adds the extension that matches the magic number of the
+ * image to the base name of an output file. The name "-", which stands for
+ * standard output, is returned unchanged. Every extension given here is
+ * also listed in OUTPUT_EXTENSIONS, so the cache finds the results.
+ *
+ * @param[in]  img - defined image structure to obtain magic number from.
+ * @param[in]  filename - base name of the output file.
+ *
+ * @return the file name with its extension.
+ *
+ * @par Example
+ * @verbatim
+   img.magicNumber = "P5";
+   string name = outputName(img, "gray"); //name is "gray.pgm"
+   @endverbatim
+ *****************************************************************************/
+string outputName(image& img, string filename)
+{
+    if (filename == "-")
+    {
+        return filename;
+    }
+
+    if (img.magicNumber == "P3" || img.magicNumber == "P6")
+    {
+        filename = filename + ".ppm";
+    }
+
+    else if (img.magicNumber == "P2" || img.magicNumber == "P5")
+    {
+        filename = filename + ".pgm";
+    }
+
+    else if (img.magicNumber == "P1" || img.magicNumber == "P4")
     {
-        cout << "Unable to open the file: " << filename << endl;
-        exit(0);
+        filename = filename + ".pbm";
+    }
+
+    else if (img.magicNumber[0] == 'T')
+    {
+        filename = filename + ".tpi";
     }
+
+    else if (img.magicNumber == "P7" || img.magicNumber == "P7G")
+    {
+        filename = filename + ".pam";
+    }
+
+    else if (img.magicNumber == "YUV" || img.magicNumber == "YUVG")
+    {
+        filename = filename + ".yuv";
+    }
+
+    return filename;
 }
 
-//READ DATA FROM IMAGE FILE
+//ASCII DIGIT TABLE
 /** ***************************************************************************
  * @author Steve Nathan de Sa
  *
  * @par Description
- * This function reads the data from the file according to the file type as
- * specified by the magic number. The data is stored in the structure image 
- * for use later on in the code for editting and printing out.
+ * This function returns a table holding the text of every pixel value, so
+ * the ascii encoder copies digits instead of dividing by ten. Entry v holds
+ * the digits of v in its first bytes and the number of digits in byte 3.
+ * The table is filled the first time the function is called.
  *
- * @param[in, out]  fin - ifstream file declaration to edit file.
- * @param[in, out]  img - defined image structure to store data in.
+ * @return the table of 256 entries.
  *
- * @return true if the function successfully reads the file data.
- * 
  * @par Example
  * @verbatim
-   ifstream fin;
-   string filename = "steve.txt";
-   openIPFile(fin,filename); //opens file named steve.txt
-   image img; //structure
-   if(readImage(fin, img)
-   {
-        cout << "File has been successfully read";
-   }
+   const char (*table)[4] = digitTable();
+   memcpy(p, table[200], 3); //p holds "200"
+   p += table[200][3];
    @endverbatim
  *****************************************************************************/
-bool readImage(ifstream& fin, image& img)
+static const char (*digitTable())[4]
 {
-    std::getline(fin, img.magicNumber);
+    static char table[256][4];
+    static bool filled = []
+    {
+        int v;
+
+        for (v = 0; v < 256; v++)
+        {
+            table[v][3] = char(snprintf(table[v], 4, "%d", v));
+        }
+
+        return true;
+    }();
 
-    string unknown;
+    (void)filled;
+
+    return table;
+}
+
+//ENCODE ASCII PIXEL DATA
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function writes the pixel data of a P3 or P2 image using every
+ * thread, in exactly the layout of writing one sample at a time: one line
+ * per pixel, with the red, green and blue values separated by spaces for
+ * P3. The rows are handled a block at a time to keep the memory used small.
+ * Each block is split into row bands, every band is formatted into its own
+ * buffer from the digit table, and the buffers are then written in order.
+ *
+ * @param[in, out]  out - stream to write the data to.
+ * @param[in]       img - defined image structure to obtain data from.
+ *
+ * @par Example
+ * @verbatim
+   writeHeader(out, img);
+   encodeASCII(out, img);
+   @endverbatim
+ *****************************************************************************/
+static void encodeASCII(ostream& out, image& img)
+{
+    const char (*table)[4] = digitTable();
+    bool color = img.magicNumber == "P3";
+    size_t pixelBytes = color ? 12 : 4;
+    int bands = bandCount(img.rows);
+    int blockRows = int(max(size_t(bands), bands * IO_CHUNK_SIZE / (pixelBytes * img.cols)));
+    vector<vector<char>> buffers(bands);
+    atomic<long long> held(0);
+    int first, b;
 
-    while (std::getline(fin, unknown) && unknown[0] == '#')
+    for (first = 0; first < img.rows; first += blockRows)
     {
-        img.comment = img.comment + unknown + '\n';
-    }
+        int count = min(blockRows, img.rows - first);
+
+        parallelBands(count, [&](int band, int from, int to)
+        {
+            vector<char>& buffer = buffers[band];
+            size_t capacity = buffer.capacity();
+            int i, j;
+
+            buffer.resize(size_t(to - from) * img.cols * pixelBytes);
+
+            //ONLY WHAT THE BUFFER GREW BY IS NEWLY ASSIGNED
+            if (buffer.capacity() > capacity)
+            {
+                trackMemory((long long)(buffer.capacity() - capacity));
+                held += (long long)(buffer.capacity() - capacity);
+            }
+
+            char* p = buffer.data();
+
+            for (i = first + from; i < first + to; i++)
+            {
+                for (j = 0; j < img.cols; j++)
+                {
+                    const char* v = table[img.redGray[i][j]];
 
-    size_t nl = (img.comment).find_last_of('\n');
-    (img.comment).erase(nl, 1);
+                    memcpy(p, v, 3);
+                    p += v[3];
 
-    size_t pos = unknown.find(" ");
-    img.cols = stoi(unknown.substr(0, pos));
-    img.rows = stoi(unknown.substr(pos + 1));
+                    if (color)
+                    {
+                        *p++ = ' ';
+                        v = table[img.green[i][j]];
+                        memcpy(p, v, 3);
+                        p += v[3];
 
-    string max_pixels;
-    std::getline(fin, max_pixels);
+                        *p++ = ' ';
+                        v = table[img.blue[i][j]];
+                        memcpy(p, v, 3);
+                        p += v[3];
+                    }
 
-    int i,j;
-    int x = 0; //COUNTER
+                    *p++ = '\n';
+                }
+            }
 
-    int inputs = 3 * img.rows * img.cols;
+            buffer.resize(size_t(p - buffer.data()));
+        });
 
-    int* avalues = nullptr;
-    pixel* bvalues = nullptr;
+        for (b = 0; b < bandCount(count); b++)
+        {
+            out.write(buffers[b].data(), streamsize(buffers[b].size()));
+        }
+    }
 
-    allocarray(img.redGray, img.rows, img.cols);
-    allocarray(img.blue, img.rows, img.cols);
-    allocarray(img.green, img.rows, img.cols);
+    buffers.clear();
+    trackMemory(-held);
+}
 
-    if (img.magicNumber == "P3" && stoi(max_pixels) <= 255) //PPM ASCII
+//WRITE NETPBM HEADER
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function writes the magic number, comment, size and maximum value of
+ * a netPBM image, ending with the single newline that comes before the data.
+ * A PAM header names each field and also gives the depth and tuple type,
+ * with an alpha channel when the image has one.
+ *
+ * @param[in, out]  out - stream to write the header to.
+ * @param[in]       img - defined image structure to obtain the header from.
+ *
+ * @par Example
+ * @verbatim
+   writeHeader(out, img);
+   //pixel data follows
+   @endverbatim
+ *****************************************************************************/
+void writeHeader(ostream& out, image& img)
+{
+    if (img.magicNumber == "P7" || img.magicNumber == "P7G")
     {
-        avalues = new (nothrow) int[inputs];
+        bool gray = img.magicNumber == "P7G";
+        bool alpha = img.alpha != nullptr;
 
-        for (i = 0; i < inputs; i++)
+        out << "P7\n";
+
+        if (!img.comment.empty())
         {
-            fin >> avalues[i];
+            out << img.comment << '\n';
         }
 
+        out << "WIDTH " << img.cols << "\nHEIGHT " << img.rows << '\n';
+        out << "DEPTH " << (gray ? 1 : 3) + (alpha ? 1 : 0) << "\nMAXVAL 255\n";
+        out << "TUPLTYPE " << (gray ? "GRAYSCALE" : "RGB") << (alpha ? "_ALPHA" : "") << '\n';
+        out << "ENDHDR\n";
+        return;
+    }
+
+    out << img.magicNumber << '\n';
+
+    if (!img.comment.empty())
+    {
+        out << img.comment << '\n';
+    }
+
+    out << img.cols << " " << img.rows << '\n';
+
+    //BITMAPS HAVE NO MAXIMUM VALUE
+    if (img.magicNumber != "P1" && img.magicNumber != "P4")
+    {
+        out << 255 << '\n';
+    }
+}
+
+//WRITE IMAGE TO STREAM
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function writes the header and pixel data of an image to a stream,
+ * in the format given by its magic number. The image is left as it is, so
+ * the frames of a multi image stream can be written one after the other.
+ *
+ * @param[in, out]  out - stream to write the image to.
+ * @param[in]       img - defined image structure to obtain data from.
+ *
+ * @par Example
+ * @verbatim
+   do
+   {
+       readImage(fin, img);
+       sepia(img, "--binary");
+       writeImageData(out, img); //frames follow each other in out
+   } while (nextFrame(fin));
+   @endverbatim
+ *****************************************************************************/
+void writeImageData(ostream& out, image& img)
+{
+    if (img.magicNumber[0] == 'T')
+    {
+        writePlanar(out, img);
+        return;
+    }
+
+    //RAW YUV HAS NO HEADER
+    if (img.magicNumber == "YUV" || img.magicNumber == "YUVG")
+    {
+        writeYUV(out, img);
+        return;
+    }
+
+    writeHeader(out, img);
+    writePixelData(out, img);
+}
+
+//WRITE PIXEL DATA TO STREAM
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function writes the pixel data of a netPBM or PAM image, without its
+ * header. Every row is written on its own, so an image may also be written
+ * a band of rows at a time, each band held in an image of its own, after a
+ * header with the size of the whole image.
+ *
+ * @param[in, out]  out - stream to write the data to.
+ * @param[in]       img - defined image structure to obtain data from.
+ *
+ * @par Example
+ * @verbatim
+   writeHeader(out, whole);
+   writePixelData(out, topBand);
+   writePixelData(out, bottomBand);
+   @endverbatim
+ *****************************************************************************/
+void writePixelData(ostream& out, image& img)
+{
+    int i, j;
+
+    if (img.magicNumber == "P3" || img.magicNumber == "P2") //ASCII
+    {
+        encodeASCII(out, img);
+    }
+
+    else if (img.magicNumber == "P6") //PPM BINARY
+    {
         for (i = 0; i < img.rows; i++)
         {
             for (j = 0; j < img.cols; j++)
             {
-                img.redGray[i][j] = pixel(avalues[x]);
-                x++;
-                img.green[i][j] = pixel(avalues[x]);
-                x++;
-                img.blue[i][j] = pixel(avalues[x]);
-                x++;
+                out.write((char*)&img.redGray[i][j], sizeof(pixel));
+                out.write((char*)&img.green[i][j], sizeof(pixel));
+                out.write((char*)&img.blue[i][j], sizeof(pixel));
             }
         }
-
-        delete[] avalues;
-        fin.close();
-        
-        return true;
     }
 
-    else if (img.magicNumber == "P6" && stoi(max_pixels) <= 255) //PPM BINARY
+    else if (img.magicNumber == "P5") //PGM BINARY
     {
-        bvalues = new (nothrow) pixel[inputs];
-
-        fin.read((char*)bvalues, sizeof(pixel)*inputs);
-
         for (i = 0; i < img.rows; i++)
         {
             for (j = 0; j < img.cols; j++)
             {
-                img.redGray[i][j] = bvalues[x];
-                x++;
-                img.green[i][j] = bvalues[x];
-                x++;
-                img.blue[i][j] = bvalues[x];
-                x++;
+                out.write((char*)&img.redGray[i][j], sizeof(pixel));
             }
         }
+    }
 
-        delete[] bvalues;
-        fin.close();
+    else if (img.magicNumber == "P1") //PBM ASCII
+    {
+        //ONE DIGIT A PIXEL, 1 FOR BLACK, WITH LINES OF AT MOST 70
+        string line;
 
-        return true;
+        for (i = 0; i < img.rows; i++)
+        {
+            for (j = 0; j < img.cols; j += 70)
+            {
+                int count = min(70, img.cols - j);
+
+                line.resize(count + 1);
+
+                for (int k = 0; k < count; k++)
+                {
+                    line[k] = img.redGray[i][j + k] < 128 ? '1' : '0';
+                }
+
+                line[count] = '\n';
+                out.write(line.data(), streamsize(line.size()));
+            }
+        }
     }
 
-    else
+    else if (img.magicNumber == "P4") //PBM BINARY
     {
-        delete[] avalues;
-        delete[] bvalues;
-        return false;
+        vector<pixel> bits((size_t(img.cols) + 7) / 8);
+
+        for (i = 0; i < img.rows; i++)
+        {
+            packBits(bits.data(), img.redGray[i], img.cols);
+            out.write((char*)bits.data(), streamsize(bits.size()));
+        }
     }
 
-    return true;
+    else if (img.magicNumber == "P7" || img.magicNumber == "P7G") //PAM
+    {
+        pixel** planes[4] = { img.redGray, img.green, img.blue, img.alpha };
+        int depth = img.magicNumber == "P7G" ? 1 : 3;
+
+        //THE ALPHA PLANE GOES LAST, AFTER ONE OR THREE COLOR PLANES
+        if (img.alpha != nullptr)
+        {
+            planes[depth++] = img.alpha;
+        }
+
+        vector<pixel> row(size_t(img.cols) * depth);
+
+        for (i = 0; i < img.rows; i++)
+        {
+            pixel* bvalues = row.data();
+
+            for (j = 0; j < img.cols; j++)
+            {
+                for (int p = 0; p < depth; p++)
+                {
+                    *bvalues++ = planes[p][i][j];
+                }
+            }
+
+            out.write((char*)row.data(), streamsize(row.size()));
+        }
+    }
 }
 
 //WRITING DATA TO THE IMAGE FILE
@@ -187,7 +1566,9 @@ bool readImage(ifstream& fin, image& img)
  *
  * @par Description
  * This function writes the modified data of the image to the new file specified
- * by the user. 
+ * by the user, or to standard output when the file name is "-". The data is
+ * handed to a second thread that writes it to the disk, so the encoder does
+ * not wait for each write to finish.
  *
  * @param[in, out]  fout - ofstream file declaration to edit file.
  * @param[in, out]  img - defined image structure to obtain data from.
@@ -212,74 +1593,180 @@ bool readImage(ifstream& fin, image& img)
 
 void writeImage(ofstream& fout, image& img, string filename)
 {
-    int i, j;
+    writeBehindBuf behind(openOutput(fout, outputName(img, filename)));
+    ostream out(&behind);
 
-    if (img.magicNumber == "P3" || img.magicNumber == "P6")
+    writeImageData(out, img);
+
+    freeimage(img);
+
+    out.flush();
+    fout.close();
+}
+
+//SINGLE BINARY PIXMAP
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads the header of an opened file and checks that the
+ * file holds a single P6 image with a maximum value of 255, all of its
+ * pixel data and nothing but comments after it. Such a file can be worked
+ * a block of rows at a time straight from the disk, in any order. The
+ * stream is left at the first byte of the pixel data.
+ *
+ * @param[in, out]  fin - opened input file.
+ * @param[out]      img - defined image structure to store the header in.
+ *
+ * @return true if the file holds a single binary pixmap.
+ *
+ * @par Example
+ * @verbatim
+   openIPFile(fin, "big.ppm");
+   if (singlePixmap(fin, img))
+   {
+       fin.read(row, 3 * img.cols); //the first row
+   }
+   @endverbatim
+ *****************************************************************************/
+bool singlePixmap(ifstream& fin, image& img)
+{
+    int maxval;
+
+    if (!readHeader(fin, img, maxval) || img.magicNumber != "P6" || maxval != 255)
     {
-        filename = filename + ".ppm";
+        return false;
     }
 
-    else if (img.magicNumber == "P2" || img.magicNumber == "P5")
+    streamoff start = fin.tellg();
+    streamoff end = start + streamoff(size_t(img.cols) * 3 * img.rows);
+
+    //THE WHOLE IMAGE MUST BE THERE, AND NOTHING BUT COMMENTS AFTER IT
+    fin.seekg(0, ios::end);
+
+    if (!fin || fin.tellg() < end)
     {
-        filename = filename + ".pgm";
+        return false;
+    }
+
+    fin.seekg(end);
+
+    if (nextFrame(fin))
+    {
+        return false;
     }
 
-    openOPFile(fout, filename);
+    fin.clear();
+    fin.seekg(start);
+
+    return true;
+}
 
-    fout << img.magicNumber << endl;
-    fout << img.comment << endl;
-    fout << img.cols << " " << img.rows << endl;
-    fout << 255 << endl;
+//MIRROR WHILE COPYING
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function does a flip or half turn of a binary ppm file without ever
+ * holding the image in memory. The rows are copied straight from the input
+ * file to the output file, a block of rows at a time. For --flipX and
+ * --rotate180 the blocks are read from the end of the file backwards and
+ * their rows written in reverse order, and for --flipY and --rotate180 the
+ * pixels of every row are reversed on the way.
+ *
+ * This only works for a file holding a single P6 image with a maximum value
+ * of 255 that is written as --binary. For anything else, including standard
+ * input, which cannot be read backwards, nothing is written and false is
+ * returned, so the caller can fall back to reading the whole image.
+ *
+ * @param[in]       option - option code given on the command line.
+ * @param[in]       type - contains type of output file needed.
+ * @param[in, out]  output - base name of the output file, given its
+ *                           extension when the image is written.
+ * @param[in]       input - name of the input file.
+ *
+ * @return true if the output file was written.
+ *
+ * @par Example
+ * @verbatim
+   string output = "flipped";
+   if (streamMirror("--flipX", "--binary", output, "big.ppm"))
+   {
+       cout << "Wrote " << output; //flipped.ppm
+   }
+   @endverbatim
+ *****************************************************************************/
+bool streamMirror(string option, string type, string& output, string input)
+{
+    ifstream fin;
+    ofstream fout;
+    image img;
+    int i;
 
-    if (img.magicNumber == "P3") //PPM ASCII
+    if (option != "--flipX" && option != "--flipY" && option != "--rotate180")
     {
-        for (i = 0; i < img.rows; i++)
-        {
-            for (j = 0; j < img.cols; j++)
-            {
-                fout << int(img.redGray[i][j]) << " " << int(img.green[i][j]) << " " << int(img.blue[i][j]) << endl;
-            }
-        }
+        return false;
     }
 
-    else if (img.magicNumber == "P6") //PPM BINARY
+    if (type != "--binary" || input == "-")
     {
-        for (i = 0; i < img.rows; i++)
-        {
-            for (j = 0; j < img.cols; j++)
-            {
-                fout.write((char*)&img.redGray[i][j], sizeof(pixel));
-                fout.write((char*)&img.green[i][j], sizeof(pixel));
-                fout.write((char*)&img.blue[i][j], sizeof(pixel));
-            }
-        }
+        return false;
     }
 
-    else if (img.magicNumber == "P2") //PGM ASCII
+    openIPFile(fin, input);
+
+    if (!singlePixmap(fin, img))
     {
-        for (i = 0; i < img.rows; i++)
-        {
-            for (j = 0; j < img.cols; j++)
-            {
-                fout << int(img.redGray[i][j]) << endl;
-            }
-        }
+        return false;
     }
 
-    else if (img.magicNumber == "P5") //PGM BINARY
+    size_t rowBytes = size_t(img.cols) * 3;
+    streamoff start = fin.tellg();
+    bool upsideDown = option != "--flipY";
+    bool mirrored = option != "--flipX";
+    int blockRows = int(max(size_t(1), IO_CHUNK_SIZE / rowBytes));
+    vector<pixel> block(rowBytes * blockRows);
+    vector<pixel> reversed(rowBytes);
+
+    trackMemory((long long)(block.size() + reversed.size()));
+
+    nextStage("open input", option);
+    stageBytes(img);
+
+    output = outputName(img, output);
+
+    writeBehindBuf behind(openOutput(fout, output));
+    ostream out(&behind);
+
+    writeHeader(out, img);
+
+    for (i = 0; i < img.rows; i += blockRows)
     {
-        for (i = 0; i < img.rows; i++)
+        int count = min(blockRows, img.rows - i);
+        int first = upsideDown ? img.rows - i - count : i;
+        int r;
+
+        fin.seekg(start + streamoff(rowBytes * first));
+        fin.read((char*)block.data(), streamsize(rowBytes * count));
+
+        for (r = 0; r < count; r++)
         {
-            for (j = 0; j < img.cols; j++)
+            pixel* row = block.data() + rowBytes * (upsideDown ? count - r - 1 : r);
+
+            if (mirrored)
             {
-                fout.write((char*)&img.redGray[i][j], sizeof(pixel));
+                reverseRowRGB(reversed.data(), row, img.cols);
+                row = reversed.data();
             }
+
+            out.write((char*)row, streamsize(rowBytes));
         }
     }
 
-    freearray(img.redGray, img.rows);
-    freearray(img.green, img.rows);
-    freearray(img.blue, img.rows);
-
+    out.flush();
     fout.close();
+
+    trackMemory(-(long long)(block.size() + reversed.size()));
+
+    return true;
 }
@@ -8,7 +8,8 @@
   *
   * @par Description
   * This function flips the image on its x-axis and changes magic number according
-  * to the type of output file needed.
+  * to the type of output file needed. No pixel is copied, the top and bottom
+  * rows just swap their row pointers.
   *
   * @param[in, out]  img - defined image structure to obtain data from.
   * @param[in]       type - contains type of output file needed.
@@ -34,28 +35,20 @@
   *****************************************************************************/
 void flipX(image& img, string type)
 {
-    int i,j;
+    int i;
 
-    if (type == "--ascii")
-    {
-        img.magicNumber = "P3";
-    }
-    else if (type == "--binary")
-    {
-        img.magicNumber = "P6";
-    }
-    else
-    {
-        error("output");
-    }
+    setOutputType(img, type, false);
 
-    for (i = 0; i < img.cols; i++)
+    //WHOLE ROWS TRADE PLACES, SO ONLY THE ROW POINTERS MOVE
+    for (i = 0; i < img.rows / 2; i++)
     {
-        for (j = 0; j < img.rows / 2; j++)
+        swap(img.redGray[i], img.redGray[img.rows - i - 1]);
+        swap(img.green[i], img.green[img.rows - i - 1]);
+        swap(img.blue[i], img.blue[img.rows - i - 1]);
+
+        if (img.alpha != nullptr)
         {
-            swap(img.redGray[j][i], img.redGray[img.rows - j - 1][i]);
-            swap(img.blue[j][i], img.blue[img.rows - j - 1][i]);
-            swap(img.green[j][i], img.green[img.rows - j - 1][i]);
+            swap(img.alpha[i], img.alpha[img.rows - i - 1]);
         }
     }
 }
@@ -91,30 +84,259 @@ void flipX(image& img, string type)
  *****************************************************************************/
 void flipY(image& img, string type)
 {
-    int i, j;
+    setOutputType(img, type, false);
 
-    if (type == "--ascii")
+    //ALL THREE PLANES OF A ROW ARE MIRRORED IN ONE VISIT
+    parallelBands(img.rows, [&](int, int first, int last)
     {
-        img.magicNumber = "P3";
-    }
-    else if (type == "--binary")
+        int i;
+
+        for (i = first; i < last; i++)
+        {
+            reverseRow(img.redGray[i], img.cols);
+            reverseRow(img.green[i], img.cols);
+            reverseRow(img.blue[i], img.cols);
+
+            if (img.alpha != nullptr)
+            {
+                reverseRow(img.alpha[i], img.cols);
+            }
+        }
+    });
+}
+
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function copies planes into planes with the rows and columns
+ * swapped. Pixel (i, j) moves to (j, i), with the new columns in reverse
+ * order when reverseRows is set and the new rows in reverse order when
+ * reverseCols is set. The copy is done one tile at a time, so both the rows
+ * read and the rows written stay in cache, with the tiles split across
+ * threads.
+ *
+ * @param[in]       img - defined image structure giving the size of from.
+ * @param[in]       from - planes to copy.
+ * @param[in, out]  to - planes assigned with the rows and columns swapped.
+ * @param[in]       planes - number of planes in from and to.
+ * @param[in]       reverseRows - the first row becomes the last column.
+ * @param[in]       reverseCols - the first column becomes the last row.
+ *
+ * @par Example
+ * @verbatim
+   transposeTiles(img, &img.green, &turned, 1, true, false);
+   @endverbatim
+ *****************************************************************************/
+static void transposeTiles(image& img, pixel** const* from, pixel** const* to,
+    int planes, bool reverseRows, bool reverseCols)
+{
+    parallelBands(tileCount(img.rows, img.cols), [&](int, int first, int last)
     {
-        img.magicNumber = "P6";
+        int t, i, j, p;
+
+        for (t = first; t < last; t++)
+        {
+            tileRect rect = tileAt(img.rows, img.cols, t);
+
+            for (j = rect.col; j < rect.col + rect.cols; j++)
+            {
+                int row = reverseCols ? img.cols - j - 1 : j;
+
+                for (p = 0; p < planes; p++)
+                {
+                    pixel** src = from[p];
+                    pixel* dst = to[p][row];
+
+                    for (i = rect.row; i < rect.row + rect.rows; i++)
+                    {
+                        dst[reverseRows ? img.rows - i - 1 : i] = src[i][j];
+                    }
+                }
+            }
+        }
+    });
+}
+
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function writes a plane to slot number slot of a temporary file and
+ * frees it. Every slot is rows * columns bytes, so the planes of an image
+ * and of the image turned on its side fit the same slots.
+ *
+ * @param[in, out]  spill - temporary file.
+ * @param[in]       slot - number of the slot to write.
+ * @param[in, out]  plane - plane to write, nullptr afterwards.
+ * @param[in]       rows - number of rows in the plane.
+ * @param[in]       cols - number of columns in the plane.
+ *
+ * @par Example
+ * @verbatim
+   spillPlane(spill, 0, img.green, img.rows, img.cols);
+   @endverbatim
+ *****************************************************************************/
+static void spillPlane(FILE* spill, int slot, pixel**& plane, int rows, int cols)
+{
+    int i;
+
+#ifdef _WIN32
+    _fseeki64(spill, (long long)slot * rows * cols, SEEK_SET);
+#else
+    fseeko(spill, off_t(slot) * rows * cols, SEEK_SET);
+#endif
+
+    for (i = 0; i < rows; i++)
+    {
+        if (fwrite(plane[i], 1, cols, spill) != size_t(cols))
+        {
+            cout << "Unable to write the temporary file." << endl;
+            exit(0);
+        }
     }
-    else
+
+    freearray(plane, rows);
+}
+
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function assigns a plane and reads it back from a slot of a
+ * temporary file written by spillPlane.
+ *
+ * @param[in, out]  spill - temporary file.
+ * @param[in]       slot - number of the slot to read.
+ * @param[out]      plane - plane to assign and fill.
+ * @param[in]       rows - number of rows in the plane.
+ * @param[in]       cols - number of columns in the plane.
+ *
+ * @par Example
+ * @verbatim
+   unspillPlane(spill, 0, img.green, img.rows, img.cols);
+   @endverbatim
+ *****************************************************************************/
+static void unspillPlane(FILE* spill, int slot, pixel**& plane, int rows, int cols)
+{
+    int i;
+
+    allocarray(plane, rows, cols);
+#ifdef _WIN32
+    _fseeki64(spill, (long long)slot * rows * cols, SEEK_SET);
+#else
+    fseeko(spill, off_t(slot) * rows * cols, SEEK_SET);
+#endif
+
+    for (i = 0; i < rows; i++)
     {
-        error("output");
+        if (fread(plane[i], 1, cols, spill) != size_t(cols))
+        {
+            cout << "Unable to read the temporary file." << endl;
+            exit(0);
+        }
     }
+}
 
-    for (i = 0; i < img.rows; i++)
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function does every transform that swaps the rows and columns of an
+ * image: rotating either way, transposing and transversing, as set by the
+ * flags described with transposeTiles. Normally all three planes are copied
+ * into new planes in one pass. When the memory plan asks for it, the planes
+ * are done one at a time instead, each old plane being freed as soon as it
+ * has been copied. With spillPlanes every plane that is not being copied
+ * waits in a temporary file, so no more than two planes are in memory
+ * until the finished planes are read back at the end. The alpha plane, if
+ * there is one, is turned along with the others.
+ *
+ * @param[in, out]  img - defined image structure to transform.
+ * @param[in]       reverseRows - the first row becomes the last column.
+ * @param[in]       reverseCols - the first column becomes the last row.
+ *
+ * @par Example
+ * @verbatim
+   transposeImage(img, true, false); //rotate clockwise
+   @endverbatim
+ *****************************************************************************/
+static void transposeImage(image& img, bool reverseRows, bool reverseCols)
+{
+    int p;
+    int count = img.alpha != nullptr ? 4 : 3;
+    pixel** planes[4] = { img.redGray, img.green, img.blue, img.alpha };
+    pixel** turned[4] = { nullptr, nullptr, nullptr, nullptr };
+    FILE* spill = nullptr;
+
+    if (!config.plan.planeAtATime && !config.plan.spillPlanes)
+    {
+        for (p = 0; p < count; p++)
+        {
+            allocarray(turned[p], img.cols, img.rows);
+        }
+
+        transposeTiles(img, planes, turned, count, reverseRows, reverseCols);
+
+        for (p = 0; p < count; p++)
+        {
+            freearray(planes[p], img.rows);
+        }
+    }
+    else
     {
-        for (j = 0; j < img.cols / 2; j++)
+        if (config.plan.spillPlanes)
+        {
+            spill = tmpfile();
+
+            if (spill == nullptr)
+            {
+                cout << "Unable to create a temporary file." << endl;
+                exit(0);
+            }
+
+            for (p = 1; p < count; p++)
+            {
+                spillPlane(spill, p - 1, planes[p], img.rows, img.cols);
+            }
+        }
+
+        for (p = 0; p < count; p++)
+        {
+            //A SPILLED PLANE IS READ BACK ONLY WHEN ITS TURN COMES
+            if (planes[p] == nullptr)
+            {
+                unspillPlane(spill, p - 1, planes[p], img.rows, img.cols);
+            }
+
+            allocarray(turned[p], img.cols, img.rows);
+            transposeTiles(img, &planes[p], &turned[p], 1, reverseRows, reverseCols);
+            freearray(planes[p], img.rows);
+
+            //FINISHED PLANES WAIT ON DISK TOO, UNTIL THE LAST ONE IS DONE
+            if (spill != nullptr && p < count - 1)
+            {
+                spillPlane(spill, count - 1 + p, turned[p], img.cols, img.rows);
+            }
+        }
+
+        if (spill != nullptr)
         {
-            swap(img.redGray[i][j], img.redGray[i][img.cols - j - 1]);
-            swap(img.blue[i][j], img.blue[i][img.cols - j - 1]);
-            swap(img.green[i][j], img.green[i][img.cols - j - 1]);
+            for (p = 0; p < count - 1; p++)
+            {
+                unspillPlane(spill, count - 1 + p, turned[p], img.cols, img.rows);
+            }
+
+            fclose(spill);
         }
     }
+
+    img.redGray = turned[0];
+    img.green = turned[1];
+    img.blue = turned[2];
+    img.alpha = turned[3];
+
+    swap(img.cols, img.rows);
 }
 
 /** ***************************************************************************
@@ -148,62 +370,9 @@ void flipY(image& img, string type)
  *****************************************************************************/
 void rotateCW(image& img, string type)
 {
-    int i, j;
-
-    if (type == "--ascii")
-    {
-        img.magicNumber = "P3";
-    }
-    else if (type == "--binary")
-    {
-        img.magicNumber = "P6";
-    }
-    else
-    {
-        error("output");
-    }
-
-    pixel** tR;
-    pixel** tG;
-    pixel** tB;
-
-    allocarray(tR, img.cols, img.rows);
-    allocarray(tG, img.cols, img.rows);
-    allocarray(tB, img.cols, img.rows);
-
-    for (i = 0; i < img.cols; i++)
-    {
-        for (j = 0; j < img.rows; j++)
-        {
-            tR[i][j] = img.redGray[img.rows - j - 1][i];
-            tG[i][j] = img.green[img.rows - j - 1][i];
-            tB[i][j] = img.blue[img.rows - j - 1][i];
-        }
-    }
-
-    freearray(img.redGray, img.rows);
-    freearray(img.green, img.rows);
-    freearray(img.blue, img.rows);
-
-    allocarray(img.redGray, img.cols, img.rows);
-    allocarray(img.green, img.cols, img.rows);
-    allocarray(img.blue, img.cols, img.rows);
-
-    swap(img.cols, img.rows);
+    setOutputType(img, type, false);
 
-    for (i = 0; i < img.rows; i++)
-    {
-        for (j = 0; j < img.cols; j++)
-        {
-            img.redGray[i][j] = tR[i][j];
-            img.green[i][j] = tG[i][j];
-            img.blue[i][j] = tB[i][j];
-        }
-    }
-
-    freearray(tR, img.rows);
-    freearray(tG, img.rows);
-    freearray(tB, img.rows);
+    transposeImage(img, true, false);
 }
 
 /** ***************************************************************************
@@ -237,63 +406,121 @@ void rotateCW(image& img, string type)
  *****************************************************************************/
 void rotateCCW(image& img, string type)
 {
-    int i,j;
+    setOutputType(img, type, false);
 
-    if (type == "--ascii")
-    {
-        img.magicNumber = "P3";
-    }
-    else if (type == "--binary")
-    {
-        img.magicNumber = "P6";
-    }
-    else
-    {
-        error("output");
-    }
+    transposeImage(img, false, true);
+}
 
-    pixel** tR;
-    pixel** tG;
-    pixel** tB;
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function rotates the image half a turn and changes magic number
+ * according to the type of output file needed. It is flipX followed by
+ * flipY: the rows trade places by swapping their pointers, so only the
+ * pixels within each row have to move, and that is done in place in a
+ * single pass.
+ *
+ * @param[in, out]  img - defined image structure to obtain data from.
+ * @param[in]       type - contains type of output file needed.
+ *
+ * @par Example
+ * @verbatim
+   string type = "-ascii";
+   string output = "output";
+   string input = "input";
 
-    allocarray(tR, img.cols, img.rows);
-    allocarray(tG, img.cols, img.rows);
-    allocarray(tB, img.cols, img.rows);
+   ifstream fin;
+   ofstream fout;
+   image img;
 
-    for (i = 0; i < img.cols; i++)
-    {
-        for (j = 0; j < img.rows; j++)
-        {
-            (tR[img.cols - i - 1][img.rows - j - 1] = img.redGray[img.rows - j - 1][i]);
-            (tG[img.cols - i - 1][img.rows - j - 1] = img.green[img.rows - j - 1][i]);
-            (tB[img.cols - i - 1][img.rows - j - 1] = img.blue[img.rows - j - 1][i]);
-        }
-    }
+   openIPFile(fin, input);
+
+   if (readImage(fin, img))
+   {
+       rotate180(img, type);
+       writeImage(fout, img, output);
+   }
+   @endverbatim
+ *****************************************************************************/
+void rotate180(image& img, string type)
+{
+    flipX(img, type);
+    flipY(img, type);
+}
+
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function flips the image over the diagonal from its top left to its
+ * bottom right corner and changes magic number according to the type of
+ * output file needed.
+ *
+ * @param[in, out]  img - defined image structure to obtain data from.
+ * @param[in]       type - contains type of output file needed.
+ *
+ * @par Example
+ * @verbatim
+   string type = "-ascii";
+   string output = "output";
+   string input = "input";
 
+   ifstream fin;
+   ofstream fout;
+   image img;
 
-    freearray(img.redGray, img.rows);
-    freearray(img.green, img.rows);
-    freearray(img.blue, img.rows);
+   openIPFile(fin, input);
 
-    allocarray(img.redGray, img.cols, img.rows);
-    allocarray(img.blue, img.cols, img.rows);
-    allocarray(img.green, img.cols, img.rows);
+   if (readImage(fin, img))
+   {
+       transpose(img, type);
+       writeImage(fout, img, output);
+   }
+   @endverbatim
+ *****************************************************************************/
+void transpose(image& img, string type)
+{
+    setOutputType(img, type, false);
 
-    swap(img.cols, img.rows);
+    transposeImage(img, false, false);
+}
 
-    for (i = 0; i < img.rows; i++)
-    {
-        for (j = 0; j < img.cols; j++)
-        {
-            img.redGray[i][j] = tR[i][j];
-            img.green[i][j] = tG[i][j];
-            img.blue[i][j] = tB[i][j];
-        }
-    }
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function flips the image over the diagonal from its top right to its
+ * bottom left corner and changes magic number according to the type of
+ * output file needed.
+ *
+ * @param[in, out]  img - defined image structure to obtain data from.
+ * @param[in]       type - contains type of output file needed.
+ *
+ * @par Example
+ * @verbatim
+   string type = "-ascii";
+   string output = "output";
+   string input = "input";
+
+   ifstream fin;
+   ofstream fout;
+   image img;
+
+   openIPFile(fin, input);
+
+   if (readImage(fin, img))
+   {
+       transverse(img, type);
+       writeImage(fout, img, output);
+   }
+   @endverbatim
+ *****************************************************************************/
+void transverse(image& img, string type)
+{
+    setOutputType(img, type, false);
 
-    freearray(tR, img.rows);
-    freearray(tG, img.rows);
-    freearray(tB, img.rows);
+    transposeImage(img, true, true);
 }
 
 /** ***************************************************************************
@@ -329,18 +556,7 @@ void grayscale(image& img, string type)
 {
     int i, j;
 
-    if (type == "--ascii")
-    {
-        img.magicNumber = "P2";
-    }
-    else if (type == "--binary")
-    {
-        img.magicNumber = "P5";
-    }
-    else
-    {
-        error("output");
-    }
+    setOutputType(img, type, true);
 
     for (i = 0; i < img.rows; i++)
     {
@@ -388,18 +604,7 @@ void sepia(image& img, string type)
 {
     int i, j;
 
-    if (type == "--ascii")
-    {
-        img.magicNumber = "P3";
-    }
-    else if (type == "--binary")
-    {
-        img.magicNumber = "P6";
-    }
-    else
-    {
-        error("output");
-    }
+    setOutputType(img, type, false);
 
     for (i = 0; i < img.rows; i++)
     {
@@ -420,6 +625,63 @@ void sepia(image& img, string type)
     }
 }
 
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function changes the magic number of the image according to the type
+ * of output file needed, and whether the image is gray or in color. The
+ * program ends with the usage statement if the output type is not known.
+ *
+ *      Output Type    Color    Gray
+ *      --ascii        P3       P2
+ *      --binary       P6       P5
+ *      --planar       TP3      TP1
+ *      --compressed   TZ3      TZ1
+ *      --pam          P7       P7G
+ *      --yuv          YUV      YUVG
+ *
+ * @param[in, out]  img - defined image structure to edit.
+ * @param[in]       type - contains type of output file needed.
+ * @param[in]       gray - true if only the gray plane is to be written.
+ *
+ * @par Example
+ * @verbatim
+   setOutputType(img, "--binary", true); //img.magicNumber is now P5
+   @endverbatim
+ *****************************************************************************/
+void setOutputType(image& img, string type, bool gray)
+{
+    if (type == "--ascii")
+    {
+        img.magicNumber = gray ? "P2" : "P3";
+    }
+    else if (type == "--binary")
+    {
+        img.magicNumber = gray ? "P5" : "P6";
+    }
+    else if (type == "--planar")
+    {
+        img.magicNumber = gray ? "TP1" : "TP3";
+    }
+    else if (type == "--compressed")
+    {
+        img.magicNumber = gray ? "TZ1" : "TZ3";
+    }
+    else if (type == "--pam")
+    {
+        img.magicNumber = gray ? "P7G" : "P7";
+    }
+    else if (type == "--yuv")
+    {
+        img.magicNumber = gray ? "YUVG" : "YUV";
+    }
+    else
+    {
+        error("output");
+    }
+}
+
 /** ***************************************************************************
  * @author Steve Nathan de Sa
  *
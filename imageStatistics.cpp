@@ -0,0 +1,369 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+//CLEAR STATISTICS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function empties the histograms of a statistics structure so that
+ * pixels can be counted into it.
+ *
+ * @param[in, out]  stats - statistics structure to clear.
+ *
+ * @par Example
+ * @verbatim
+   imageStats stats;
+   clearStats(stats); //all histogram bins are now 0
+   @endverbatim
+ *****************************************************************************/
+void clearStats(imageStats& stats)
+{
+    int c, v;
+
+    for (c = 0; c < 3; c++)
+    {
+        for (v = 0; v < 256; v++)
+        {
+            stats.histogram[c][v] = 0;
+        }
+
+        stats.min[c] = 0;
+        stats.max[c] = 0;
+        stats.mean[c] = 0;
+    }
+
+    stats.count = 0;
+}
+
+//FINISH STATISTICS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function derives the minimum, maximum and mean of every channel from
+ * the histograms, once all the pixels have been counted into them. Working
+ * from the 256 bins keeps this cheap no matter how large the image is.
+ *
+ * @param[in, out]  stats - statistics structure with filled histograms.
+ *
+ * @par Example
+ * @verbatim
+   imageStats stats;
+   clearStats(stats);
+   stats.histogram[0][10] = 1;
+   stats.count = 1;
+   finishStats(stats); //stats.min[0], stats.max[0] and stats.mean[0] are 10
+   @endverbatim
+ *****************************************************************************/
+void finishStats(imageStats& stats)
+{
+    int c, v;
+
+    for (c = 0; c < 3; c++)
+    {
+        long long sum = 0;
+
+        stats.min[c] = 255;
+        stats.max[c] = 0;
+
+        for (v = 0; v < 256; v++)
+        {
+            if (stats.histogram[c][v] != 0)
+            {
+                if (v < stats.min[c])
+                {
+                    stats.min[c] = v;
+                }
+                stats.max[c] = v;
+                sum = sum + stats.histogram[c][v] * v;
+            }
+        }
+
+        if (stats.count == 0)
+        {
+            stats.min[c] = 0;
+            stats.mean[c] = 0;
+        }
+        else
+        {
+            stats.mean[c] = double(sum) / double(stats.count);
+        }
+    }
+}
+
+//MERGE STATISTICS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function adds the histograms and pixel count of part of an image,
+ * counted on its own, to the statistics of the whole.
+ *
+ * @param[in, out]  stats - statistics of the whole image.
+ * @param[in]       part - statistics of one part of the image.
+ *
+ * @par Example
+ * @verbatim
+   clearStats(stats);
+   mergeStats(stats, partial[0]);
+   mergeStats(stats, partial[1]);
+   finishStats(stats);
+   @endverbatim
+ *****************************************************************************/
+void mergeStats(imageStats& stats, const imageStats& part)
+{
+    int c, v;
+
+    for (c = 0; c < 3; c++)
+    {
+        for (v = 0; v < 256; v++)
+        {
+            stats.histogram[c][v] += part.histogram[c][v];
+        }
+    }
+
+    stats.count += part.count;
+}
+
+//COMPUTE STATISTICS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function computes the per channel histograms, minimum, maximum and
+ * mean of an image in a single pass. Every row band counts into its own
+ * histograms so the threads never share a counter, and the band histograms
+ * are merged once all the bands are done.
+ *
+ * @param[in]       img - defined image structure to obtain data from.
+ * @param[in, out]  stats - statistics structure to fill.
+ *
+ * @par Example
+ * @verbatim
+   imageStats stats;
+   computeStats(img, stats);
+   cout << "Mean red: " << stats.mean[0];
+   @endverbatim
+ *****************************************************************************/
+void computeStats(image& img, imageStats& stats)
+{
+    int b;
+    vector<imageStats> partial(bandCount(img.rows));
+
+    parallelBands(img.rows, [&](int band, int first, int last)
+    {
+        imageStats& local = partial[band];
+        int i, j;
+
+        clearStats(local);
+
+        for (i = first; i < last; i++)
+        {
+            for (j = 0; j < img.cols; j++)
+            {
+                local.histogram[0][img.redGray[i][j]]++;
+                local.histogram[1][img.green[i][j]]++;
+                local.histogram[2][img.blue[i][j]]++;
+            }
+        }
+
+        local.count = (long long)(last - first) * img.cols;
+    });
+
+    clearStats(stats);
+
+    for (b = 0; b < int(partial.size()); b++)
+    {
+        mergeStats(stats, partial[b]);
+    }
+
+    finishStats(stats);
+}
+
+//PRINT STATISTICS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function prints the minimum, maximum and mean of every channel as a
+ * small table.
+ *
+ * @param[in, out]  out - stream to print the table to.
+ * @param[in]       stats - finished statistics structure.
+ *
+ * @par Example
+ * @verbatim
+   imageStats stats;
+   computeStats(img, stats);
+   printStats(cout, stats);
+   //Channel    Min    Max      Mean
+   //Red          0    255    118.42
+   //...
+   @endverbatim
+ *****************************************************************************/
+void printStats(ostream& out, imageStats& stats)
+{
+    int c;
+    const char* names[3] = { "Red", "Green", "Blue" };
+
+    out << "Channel    Min    Max      Mean" << endl;
+
+    for (c = 0; c < 3; c++)
+    {
+        out << left << setw(8) << names[c] << right
+            << setw(6) << stats.min[c]
+            << setw(7) << stats.max[c]
+            << setw(10) << fixed << setprecision(2) << stats.mean[c] << endl;
+    }
+}
+
+//APPLY LOOKUP TABLE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function replaces every pixel of the three channels with its entry in
+ * that channel's lookup table. The rows are split into bands that are
+ * processed in parallel.
+ *
+ * @param[in, out]  img - defined image structure to modify.
+ * @param[in]       lut - one 256 entry table for each of red, green, blue.
+ *
+ * @par Example
+ * @verbatim
+   pixel lut[3][256];
+   //fill lut with an inverting table, lut[c][v] = 255 - v
+   applyLUT(img, lut); //the image is now a negative
+   @endverbatim
+ *****************************************************************************/
+void applyLUT(image& img, pixel lut[3][256])
+{
+    parallelBands(img.rows, [&](int, int first, int last)
+    {
+        int i, j;
+
+        for (i = first; i < last; i++)
+        {
+            for (j = 0; j < img.cols; j++)
+            {
+                img.redGray[i][j] = lut[0][img.redGray[i][j]];
+                img.green[i][j] = lut[1][img.green[i][j]];
+                img.blue[i][j] = lut[2][img.blue[i][j]];
+            }
+        }
+    });
+}
+
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function prints the histogram statistics of the image and changes
+ * magic number according to the type of output file needed. The image data
+ * itself is left unchanged. When stats is given, it must already hold the
+ * statistics of img, such as the ones readImage gathers while decoding.
+ *
+ * @param[in, out]  img - defined image structure to obtain data from.
+ * @param[in]       type - contains type of output file needed.
+ * @param[in]       stats - statistics of img, or nullptr to compute them.
+ *
+ * @par Example
+ * @verbatim
+   imageStats stats;
+
+   openIPFile(fin, input);
+
+   if (readImage(fin, img, &stats))
+   {
+       statistics(img, type, &stats);
+       writeImage(fout, img, output);
+   }
+   @endverbatim
+ *****************************************************************************/
+void statistics(image& img, string type, imageStats* stats)
+{
+    imageStats local;
+
+    setOutputType(img, type, false);
+
+    if (stats == nullptr)
+    {
+        computeStats(img, local);
+        stats = &local;
+    }
+
+    printStats(cout, *stats);
+}
+
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function stretches the levels of every channel so that its darkest
+ * value becomes 0 and its brightest becomes 255, and changes magic number
+ * according to the type of output file needed. The stretch is built as a
+ * lookup table from the channel minimum and maximum and then applied with
+ * applyLUT. A channel holding a single value is left unchanged.
+ *
+ * @param[in, out]  img - defined image structure to obtain data from.
+ * @param[in]       type - contains type of output file needed.
+ * @param[in]       stats - statistics of img, or nullptr to compute them.
+ *
+ * @par Example
+ * @verbatim
+   imageStats stats;
+
+   openIPFile(fin, input);
+
+   if (readImage(fin, img, &stats))
+   {
+       autolevels(img, type, &stats);
+       writeImage(fout, img, output);
+   }
+   @endverbatim
+ *****************************************************************************/
+void autolevels(image& img, string type, imageStats* stats)
+{
+    int c, v;
+    imageStats local;
+    pixel lut[3][256];
+
+    setOutputType(img, type, false);
+
+    if (stats == nullptr)
+    {
+        computeStats(img, local);
+        stats = &local;
+    }
+
+    for (c = 0; c < 3; c++)
+    {
+        int low = stats->min[c];
+        int high = stats->max[c];
+
+        for (v = 0; v < 256; v++)
+        {
+            if (high <= low)
+            {
+                lut[c][v] = pixel(v);
+            }
+            else if (v <= low)
+            {
+                lut[c][v] = 0;
+            }
+            else if (v >= high)
+            {
+                lut[c][v] = 255;
+            }
+            else
+            {
+                lut[c][v] = pixel(edit(round((v - low) * 255.0 / (high - low))));
+            }
+        }
+    }
+
+    applyLUT(img, lut);
+}
@@ -3,6 +3,232 @@
  ****************************************************************************/
 #include "netPBM.h"
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Bytes in front of every array assigned by allocarray, holding the size
+* of its block and how it was assigned. 16 keeps the row pointers and
+* pixels aligned.
+************************************************************************/
+const size_t BLOCK_HEADER = 16;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Size of a huge page. Blocks at least this large are placed on huge pages
+* where the system allows it.
+************************************************************************/
+const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Ways a block can be assigned, kept in its header so it is freed the same
+* way.
+************************************************************************/
+const size_t BLOCK_NEW = 0;
+const size_t BLOCK_MAPPED = 1;
+const size_t BLOCK_VIRTUAL = 2;
+const size_t BLOCK_HUGE = 3;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Bytes of image memory currently assigned, the most ever assigned at one
+* time, and the lock guarding both.
+************************************************************************/
+static long long memoryUsed = 0;
+static long long memoryHigh = 0;
+static mutex memoryLock;
+
+//COUNT MEMORY
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function records that image memory was assigned or freed, so the
+ * peak memory of a run can be reported. Every large buffer of the program
+ * is counted, the planes through allocarray and freearray and the others
+ * where they are made.
+ *
+ * @param[in]  bytes - bytes assigned, or minus the bytes freed.
+ *
+ * @par Example
+ * @verbatim
+   vector<char> data(size);
+   trackMemory(size);
+   //use data
+   trackMemory(-size);
+   @endverbatim
+ *****************************************************************************/
+void trackMemory(long long bytes)
+{
+    lock_guard<mutex> guard(memoryLock);
+
+    memoryUsed += bytes;
+    memoryHigh = max(memoryHigh, memoryUsed);
+}
+
+//PEAK MEMORY
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function returns the most image memory assigned at one time so far.
+ *
+ * @return peak memory in bytes.
+ *
+ * @par Example
+ * @verbatim
+   cout << "Peak memory: " << peakMemory() << " bytes";
+   @endverbatim
+ *****************************************************************************/
+long long peakMemory()
+{
+    lock_guard<mutex> guard(memoryLock);
+
+    return memoryHigh;
+}
+
+//ASSIGN BLOCK
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function assigns a block of memory for an array. Small blocks come
+ * from new. Large blocks on Linux are mapped directly and marked for
+ * transparent huge pages, which cuts the TLB misses of walking a large
+ * image, and with --huge-pages they are first tried on explicit huge pages
+ * from the system pool. On Windows, --huge-pages tries large pages, which
+ * the user must have the right to lock in memory for. Whatever cannot be
+ * placed on huge pages falls back to ordinary memory.
+ *
+ * @param[in]   bytes - size of the block.
+ * @param[out]  kind - how the block was assigned, for freeblock.
+ *
+ * @return the block, or nullptr if there is not enough memory.
+ *
+ * @par Example
+ * @verbatim
+   size_t kind;
+   char* block = allocblock(bytes, kind);
+   freeblock(block, bytes, kind);
+   @endverbatim
+ *****************************************************************************/
+static char* allocblock(size_t bytes, size_t& kind)
+{
+    kind = BLOCK_NEW;
+
+#ifdef __linux__
+    if (bytes >= HUGE_PAGE_SIZE)
+    {
+        size_t rounded = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        void* block = MAP_FAILED;
+
+        if (config.hugePages)
+        {
+            block = mmap(nullptr, rounded, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+            if (block != MAP_FAILED)
+            {
+                kind = BLOCK_HUGE;
+                return (char*)block;
+            }
+        }
+
+        block = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (block != MAP_FAILED)
+        {
+            madvise(block, bytes, MADV_HUGEPAGE);
+
+            kind = BLOCK_MAPPED;
+            return (char*)block;
+        }
+    }
+#endif
+
+#ifdef _WIN32
+    size_t large = GetLargePageMinimum();
+
+    if (config.hugePages && large > 0 && bytes >= large)
+    {
+        size_t rounded = (bytes + large - 1) / large * large;
+        void* block = VirtualAlloc(nullptr, rounded,
+            MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+        if (block != nullptr)
+        {
+            kind = BLOCK_VIRTUAL;
+            return (char*)block;
+        }
+    }
+#endif
+
+    return new (nothrow) char[bytes];
+}
+
+//FREE BLOCK
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function frees a block assigned by allocblock.
+ *
+ * @param[in]  block - the block.
+ * @param[in]  bytes - size the block was assigned with.
+ * @param[in]  kind - how the block was assigned.
+ *
+ * @par Example
+ * @verbatim
+   size_t kind;
+   char* block = allocblock(bytes, kind);
+   freeblock(block, bytes, kind);
+   @endverbatim
+ *****************************************************************************/
+static void freeblock(char* block, size_t bytes, size_t kind)
+{
+#ifdef __linux__
+    //A BLOCK ON EXPLICIT HUGE PAGES WAS MAPPED ROUNDED UP
+    if (kind == BLOCK_HUGE)
+    {
+        munmap(block, (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+        return;
+    }
+
+    if (kind == BLOCK_MAPPED)
+    {
+        munmap(block, bytes);
+        return;
+    }
+#endif
+
+#ifdef _WIN32
+    if (kind == BLOCK_VIRTUAL)
+    {
+        VirtualFree(block, 0, MEM_RELEASE);
+        return;
+    }
+#endif
+
+    delete[] block;
+}
+
 //2D ARRAY ALLOCATION
 /** ***************************************************************************
  * @author Steve Nathan de Sa
@@ -10,7 +236,13 @@
  * @par Description
  * This function accepts a 2d pointer array and assigns 2d memory 
  * to the array of n rows and m columns, based on the number of rows and 
- * columns provided by the user.
+ * columns provided by the user. The row pointers and the pixels are one
+ * block, with the rows stored top to bottom after the pointers, so the
+ * whole array is a single allocation. The size of the block is kept in
+ * front of it, so it can be counted by trackMemory. A large array may be
+ * placed on huge pages. The pixels are not cleared, as the caller fills
+ * them. Operations that rearrange rows only move the row pointers, which
+ * is why the rows may later be in any order.
  *
  * @param[in, out]  array - accepts 2d pointer array, to assign dynamic memory.
  * @param[in]       rows - number of rows of memory to assign.
@@ -28,27 +260,68 @@
 void allocarray(pixel** &array, int rows, int columns)
 {
     int i;
+    size_t kind;
+    size_t table = sizeof(pixel*) * rows;
+    size_t bytes = BLOCK_HEADER + table + size_t(rows) * columns;
+    char* block = allocblock(bytes, kind);
 
-    array = new (nothrow) pixel*[rows];
-
-    if (array == nullptr)
+    if (block == nullptr)
     {
         cout << "Unable to allocate memory for storage." << endl;
-        delete[] array;
         exit(0);
     }
 
+    ((size_t*)block)[0] = bytes;
+    ((size_t*)block)[1] = kind;
+    trackMemory((long long)bytes);
+
+    array = (pixel**)(block + BLOCK_HEADER);
+
     for (i = 0; i < rows; i++)
     {
-        array[i] = new (nothrow) pixel[columns];
+        array[i] = (pixel*)(block + BLOCK_HEADER + table) + size_t(i) * columns;
+    }
+}
 
-        if (array[i] == nullptr)
-        {
-            cout << "Unable to allocate memory for storage." << endl;
-            freearray(array, i);
-            exit(0);
-        }
+//IMAGE PLANE ALLOCATION
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function makes sure the three planes of an image are assigned with
+ * img.rows rows and img.cols columns. Planes that already have that size are
+ * kept as they are, which saves the allocation when the frames of a stream
+ * all have the same size. Otherwise the old planes are freed first, the
+ * alpha plane included, which the reader assigns again if it needs one.
+ *
+ * @param[in, out]  img - defined image structure with its new size set.
+ * @param[in]       oldRows - number of rows the planes currently have.
+ * @param[in]       oldCols - number of columns the planes currently have.
+ *
+ * @par Example
+ * @verbatim
+   int oldRows = img.rows;
+   int oldCols = img.cols;
+   img.rows = 486;
+   img.cols = 735;
+   resizeimage(img, oldRows, oldCols); //planes now hold 486 x 735 pixels
+   @endverbatim
+ *****************************************************************************/
+void resizeimage(image& img, int oldRows, int oldCols)
+{
+    if (img.redGray != nullptr && img.rows == oldRows && img.cols == oldCols)
+    {
+        return;
     }
+
+    freearray(img.redGray, oldRows);
+    freearray(img.green, oldRows);
+    freearray(img.blue, oldRows);
+    freearray(img.alpha, oldRows);
+
+    allocarray(img.redGray, img.rows, img.cols);
+    allocarray(img.green, img.rows, img.cols);
+    allocarray(img.blue, img.rows, img.cols);
 }
 
 //2D ARRAY DELETION
@@ -57,10 +330,13 @@ void allocarray(pixel** &array, int rows, int columns)
  *
  * @par Description
  * This function accepts an initiated 2d dynamic pointer array and clears its
- * data memory.
+ * data memory. The array is set back to nullptr, so freeing it twice is
+ * harmless. The row pointers and pixels were assigned as one block, so the
+ * number of rows is not needed, and the rows may be in any order.
  *
  * @param[in, out]  array - accepts 2d pointer array, to erase dynamic memory.
- * @param[in]       rows - number of rows of memory in file.
+ * @param[in]       rows - number of rows of memory in file, which is not
+ *                         needed.
  *
  * @par Example
  * @verbatim
@@ -73,19 +349,43 @@ void allocarray(pixel** &array, int rows, int columns)
    //now array has its memory freed up, with memory erased
    @endverbatim
  *****************************************************************************/
-void freearray(pixel** &array, int rows)
+void freearray(pixel** &array, int)
 {
-    int i;
-
     if (array == nullptr)
     {
         return;
     }
 
-    for (i = 0; i < rows; i++)
-    {
-        delete[] array[i];
-    }
+    char* block = (char*)array - BLOCK_HEADER;
+    size_t bytes = ((size_t*)block)[0];
+
+    trackMemory(-(long long)bytes);
+
+    freeblock(block, bytes, ((size_t*)block)[1]);
+    array = nullptr;
+}
 
-    delete[] array;
+//IMAGE DELETION
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function clears the memory of every plane of an image, the alpha
+ * plane included.
+ *
+ * @param[in, out]  img - defined image structure to erase memory of.
+ *
+ * @par Example
+ * @verbatim
+   image img;
+   readImage(fin, img);
+   freeimage(img); //all planes are nullptr again
+   @endverbatim
+ *****************************************************************************/
+void freeimage(image& img)
+{
+    freearray(img.redGray, img.rows);
+    freearray(img.green, img.rows);
+    freearray(img.blue, img.rows);
+    freearray(img.alpha, img.rows);
 }
@@ -0,0 +1,369 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+//FORMAT SIZE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function turns a number of bytes into text in mebibytes, the unit
+ * memory limits are usually given in.
+ *
+ * @param[in]  bytes - number of bytes.
+ *
+ * @return the size as text, such as "12.5 MB".
+ *
+ * @par Example
+ * @verbatim
+   cout << formatSize(1 << 20); //1.0 MB
+   @endverbatim
+ *****************************************************************************/
+static string formatSize(long long bytes)
+{
+    char text[32];
+
+    snprintf(text, sizeof(text), "%.1f MB", bytes / 1048576.0);
+
+    return text;
+}
+
+//CAN STREAM
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function tells whether streamMirror can do the job, in which case
+ * the image is never held in memory.
+ *
+ * @param[in]  option - option code given on the command line.
+ * @param[in]  type - contains type of output file needed.
+ * @param[in]  img - header of the input image.
+ * @param[in]  maxval - maximum value of the input image.
+ *
+ * @return true if the job can be streamed.
+ *
+ * @par Example
+ * @verbatim
+   if (canStream("--flipX", "--binary", img, 255))
+   {
+       cout << "Streaming";
+   }
+   @endverbatim
+ *****************************************************************************/
+static bool canStream(string option, string type, image& img, int maxval)
+{
+    return (option == "--flipX" || option == "--flipY" || option == "--rotate180") &&
+        type == "--binary" && img.magicNumber == "P6" && maxval == 255;
+}
+
+//OVERLAY MEMORY
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function estimates the memory the overlay of --overlay holds. The
+ * overlay is kept for the whole run, premultiplied by its alpha and always
+ * with an alpha plane, so it holds four planes of its own size.
+ *
+ * @param[in]  filename - name of the overlay file.
+ *
+ * @return estimated bytes held by the overlay, 0 if its header cannot be
+ *         read, as the job then fails when the overlay is loaded.
+ *
+ * @par Example
+ * @verbatim
+   long long held = overlayBytes(config.overlayFile);
+   @endverbatim
+ *****************************************************************************/
+static long long overlayBytes(string filename)
+{
+    ifstream fin(filename, ios::binary);
+    image over;
+    int maxval;
+
+    if (!fin.is_open())
+    {
+        return 0;
+    }
+
+    if (fin.peek() == 'T' ? !readPlanarHeader(fin, over) : !readHeader(fin, over, maxval))
+    {
+        return 0;
+    }
+
+    return 4 * ((long long)over.rows * over.cols + (long long)sizeof(pixel*) * over.rows);
+}
+
+//ESTIMATE PEAK MEMORY
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function estimates the most memory a job uses at one time with a given
+ * plan. A job holds the stream buffers and the planes, three or four with
+ * alpha, the whole time, and on top of that whatever the step using the most
+ * memory needs: reading, which may gather the text of an ascii image or the
+ * compressed planes of a planar one, the operation, where rotating and
+ * transposing assign new planes, pyramids hold every level and error
+ * diffusion dithering holds two rows of errors and the progress of every
+ * row, or writing, which formats or compresses into buffers. An overlay is
+ * held the whole time as well.
+ *
+ * @param[in]  option - option code given on the command line.
+ * @param[in]  type - contains type of output file needed.
+ * @param[in]  img - header of the input image.
+ * @param[in]  dataBytes - bytes of pixel data in the input file.
+ * @param[in]  planes - number of planes, 4 if the image has alpha.
+ * @param[in]  plan - ways of saving memory to assume.
+ *
+ * @return estimated peak memory in bytes.
+ *
+ * @par Example
+ * @verbatim
+   memoryPlan plan;
+   long long bytes = estimatePeak("--rotateCW", "--ascii", img, size, 3, plan);
+   @endverbatim
+ *****************************************************************************/
+static long long estimatePeak(string option, string type, image& img,
+    long long dataBytes, int planes, memoryPlan& plan)
+{
+    long long pixels = (long long)img.rows * img.cols;
+    long long plane = pixels + (long long)sizeof(pixel*) * img.rows;
+    long long threads = threadCount();
+    long long buffers = 2LL * IO_CHUNK_SIZE * IO_DEPTH;
+    long long decode = 0;
+    long long work = 0;
+    long long encode = 0;
+    long long held = 0;
+    int outPlanes = option == "--grayscale" ? 1 : 3;
+
+    //THE TEXT BUFFER STARTS AT 2 BYTES A SAMPLE AND DOUBLES WHEN FULL
+    if ((img.magicNumber == "P2" || img.magicNumber == "P3") && !plan.sequentialDecode)
+    {
+        decode = (img.magicNumber == "P2" ? 2 : 6) * pixels;
+
+        while (decode < dataBytes)
+        {
+            decode *= 2;
+        }
+    }
+    else if (img.magicNumber == "P5" || img.magicNumber == "P6" || img.magicNumber == "P7")
+    {
+        decode = IO_CHUNK_SIZE;
+    }
+    else if (img.magicNumber[0] == 'T' && img.magicNumber[1] == 'Z')
+    {
+        decode = dataBytes + min(3LL, threads) * pixels;
+    }
+
+    if (option == "--rotateCW" || option == "--rotateCCW" ||
+        option == "--transpose" || option == "--transverse")
+    {
+        if (plan.spillPlanes)
+        {
+            work = 0;
+        }
+        else if (plan.planeAtATime)
+        {
+            work = plane;
+        }
+        else
+        {
+            work = planes * plane;
+        }
+    }
+    else if (option == "--pyramid")
+    {
+        //EACH LEVEL IS A QUARTER OF THE ONE BEFORE, A THIRD OF THE IMAGE IN ALL
+        work = planes * plane / 3;
+    }
+    else if (option == "--dither" && config.ditherMode != "bayer")
+    {
+        work = 2 * ((long long)img.cols + 2) * (long long)sizeof(int) +
+            (long long)img.rows * (long long)sizeof(atomic<int>);
+    }
+    else if (option == "--overlay")
+    {
+        held = overlayBytes(config.overlayFile);
+    }
+
+    if (type == "--ascii")
+    {
+        encode = threads * IO_CHUNK_SIZE;
+    }
+    else if (type == "--yuv")
+    {
+        encode = pixels + 2 * (long long)((img.rows + 1) / 2) * ((img.cols + 1) / 2);
+    }
+    else if (type == "--compressed")
+    {
+        encode = outPlanes * (long long)lz4Bound(size_t(pixels)) +
+            min((long long)outPlanes, threads) * pixels;
+    }
+
+    return buffers + planes * plane + held + max(decode, max(work, encode));
+}
+
+//PLAN MEMORY
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function picks the ways of saving memory that keep a job under the
+ * memory limit, from the size in the header of the input file, and prints
+ * the plan with its estimated peak. Flips and half turns of binary files
+ * are streamed, which needs almost no memory, and row by row options on
+ * binary files run as a pipeline holding only a few bands of rows.
+ * Otherwise the fastest way is
+ * tried first, then ascii images are read without gathering their text,
+ * then rotations and transposes work one plane at a time, and last they
+ * spill the planes they are not working on to disk. A job that cannot fit
+ * under the limit at all is refused. As the size of standard input is not
+ * known in advance, it always gets the plan using the least memory.
+ *
+ * @param[in, out]  log - stream to print the plan to.
+ * @param[in]       option - option code given on the command line.
+ * @param[in]       type - contains type of output file needed.
+ * @param[in]       input - name of the input file.
+ *
+ * @return true if the job fits under the limit, false if it is refused.
+ *
+ * @par Example
+ * @verbatim
+   config.memoryLimit = parseSize("64M");
+   planMemory(cout, "--rotateCW", "--binary", "big.ppm");
+   //Memory plan: tiled, one plane at a time; estimated peak 58.2 MB of 64.0 MB
+   @endverbatim
+ *****************************************************************************/
+bool planMemory(ostream& log, string option, string type, string input)
+{
+    memoryPlan& plan = config.plan;
+    ifstream fin;
+    image img;
+    int maxval = 255;
+    int depth = 3;
+    bool header;
+    bool rotates = option == "--rotateCW" || option == "--rotateCCW" ||
+        option == "--transpose" || option == "--transverse";
+    string steps;
+
+    if (input == "-")
+    {
+        plan.sequentialDecode = true;
+        plan.spillPlanes = true;
+
+        log << "Memory plan: size of standard input is unknown, using the least memory" << endl;
+        return true;
+    }
+
+    openIPFile(fin, input);
+
+    if (fin.peek() == 'T')
+    {
+        header = readPlanarHeader(fin, img);
+    }
+    else
+    {
+        header = readHeader(fin, img, maxval, &depth);
+    }
+
+    //A BAD FILE IS REPORTED WHEN IT IS READ
+    if (!header)
+    {
+        return true;
+    }
+
+    long long dataBytes = (long long)filesystem::file_size(input) - (long long)fin.tellg();
+    long long estimate;
+    int planes = img.magicNumber == "P7" && depth % 2 == 0 ? 4 : 3;
+
+    if (canStream(option, type, img, maxval))
+    {
+        estimate = (long long)IO_CHUNK_SIZE * (IO_DEPTH + 1);
+        steps = "streaming rows from the input file";
+    }
+    else if (canPipeline(option, type) && img.magicNumber == "P6" && maxval == 255)
+    {
+        //THE BANDS IN FLIGHT, THE DECODER'S BLOCK AND THE ASCII ENCODER'S TEXT
+        long long rowBytes = 3LL * img.cols;
+        long long rows = min((long long)img.rows, max(1LL, (long long)PIPE_BAND_BYTES / rowBytes));
+        long long band = rows * (rowBytes + 3LL * sizeof(pixel*));
+
+        estimate = (long long)IO_CHUNK_SIZE * IO_DEPTH + (PIPE_BANDS + 1) * band +
+            (type == "--ascii" ? 4 * band : 0);
+        steps = "pipelined bands of rows";
+    }
+    else
+    {
+        estimate = estimatePeak(option, type, img, dataBytes, planes, plan);
+
+        if (estimate > config.memoryLimit && (img.magicNumber == "P2" || img.magicNumber == "P3"))
+        {
+            plan.sequentialDecode = true;
+            estimate = estimatePeak(option, type, img, dataBytes, planes, plan);
+        }
+
+        if (estimate > config.memoryLimit && rotates)
+        {
+            plan.planeAtATime = true;
+            estimate = estimatePeak(option, type, img, dataBytes, planes, plan);
+        }
+
+        if (estimate > config.memoryLimit && rotates)
+        {
+            plan.planeAtATime = false;
+            plan.spillPlanes = true;
+            estimate = estimatePeak(option, type, img, dataBytes, planes, plan);
+        }
+
+        if (rotates)
+        {
+            steps = plan.spillPlanes ? "tiled, spilling planes to disk" :
+                plan.planeAtATime ? "tiled, one plane at a time" : "tiled, all planes at once";
+        }
+        else
+        {
+            steps = "in place";
+        }
+
+        if (img.magicNumber == "P2" || img.magicNumber == "P3")
+        {
+            steps += plan.sequentialDecode ? ", sequential ascii decode" : ", parallel ascii decode";
+        }
+    }
+
+    if (estimate > config.memoryLimit)
+    {
+        log << "The job needs at least " << formatSize(estimate) << " of memory, more than the limit of "
+            << formatSize(config.memoryLimit) << endl;
+        return false;
+    }
+
+    log << "Memory plan: " << steps << "; estimated peak " << formatSize(estimate)
+        << " of " << formatSize(config.memoryLimit) << endl;
+
+    return true;
+}
+
+//REPORT MEMORY
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function prints the most memory the job used at one time, as counted
+ * by trackMemory, so it can be checked against the plan.
+ *
+ * @param[in, out]  log - stream to print the peak to.
+ *
+ * @par Example
+ * @verbatim
+   processFrames(option, type, output, input);
+   reportMemory(cout); //Peak memory: 41.9 MB
+   @endverbatim
+ *****************************************************************************/
+void reportMemory(ostream& log)
+{
+    log << "Peak memory: " << formatSize(peakMemory()) << endl;
+}
@@ -25,13 +25,18 @@
   * The program reads in a netPBM type image file, in either ascii
   * or binary format, as per the type of image. 
   * 
-  * The program has 6 options to make changes to the image, ie. flip
+  * The program has 8 options to make changes to the image, ie. flip
   * image over x axis, flip image over y axis, rotate image clockwise,
-  * rotate image counterclockwise, make image gray and make image antique.
+  * rotate image counterclockwise, make image gray, make image antique,
+  * print the channel statistics and stretch the channel levels.
   * 
   * After altering the image, the modified image data is stored in a new,
   * unique file as specified by user, in either ascii or binary format.
   *
+  * An input file holding several images back to back, such as the frames
+  * of a video, has every frame altered and written to the output file in
+  * the same order.
+  *
   * @section compile_section Compiling and Usage
   *
   * @par Compiling Instructions:
@@ -39,19 +44,63 @@
   *
   * @par Usage:
     @verbatim
-    c:\> thpe11.exe [option] --outputtype basename image.ppm
+    c:\> thpe11.exe [global options] [option] --outputtype basename image.ppm
+    c:\> thpe11.exe --compare exact|maxdiff|psnr|ssim reference.ppm image.ppm
+    c:\> thpe11.exe --verify-goldens directory [baseline.txt]
+
+         Use - as basename to write to standard output, and as image.ppm
+         to read from standard input.
+
+         --compare prints whether the two images are identical and the
+         metric given, and exits with 0 if identical, 1 if not and 2 if
+         either image cannot be read.
+
+         --verify-goldens runs every option on BalloonsA.ppm and
+         BalloonsB.ppm in the directory, such as "test files", to every
+         output type, checks the results against the golden files there
+         and prints the throughput of each. A case also fails when it is
+         slower than 80% of baseline.txt, which is written if missing.
+         Last, a --dither job and a --yuv job must be answered from the
+         cache when run again.
 
          Output Type      Output Description
         --ascii      integer text numbers will be written for the data
         --binary     integer number will be written in binary form
+        --planar     planes are written as they are held in memory
+        --compressed planes are written delta filtered and LZ4 compressed
+        --pam        PAM image, keeping the alpha channel
+        --yuv        raw planar YUV 4:2:0 for video encoders
 
          Option Code      Option Description
         --flipX      Flip the image on the X axis
         --flipY      Flip the image on the Y axis
         --rotateCW   Rotate the image clockwise
         --rotateCCW  Rotate the image counter clockwise
+        --rotate180  Rotate the image half a turn
+        --transpose  Flip the image over its main diagonal
+        --transverse Flip the image over its other diagonal
         --grayscale  Convert image to grayscale
         --sepia      Antique a color image
+        --overlay    Blend the overlay file on top of the image
+        --pyramid N  Write N levels, each half the size of the last
+        --dither fs|bayer  Black and white bitmap, P1 or P4, by Floyd
+                     Steinberg error diffusion or an ordered Bayer matrix
+        --stats      Print channel minimum, maximum and mean
+        --autolevels Stretch each channel to the full range
+
+         Global Option          Option Description
+        --cache dir          Reuse results of identical jobs stored in dir
+        --cache-size size    Largest size of the cache, such as 512M or 2G
+        --memory-limit size  Keep the memory used under size, such as 256M
+        --huge-pages         Place large images on huge pages
+        --overlay-file file  Image blended on top by --overlay
+        --overlay-at x,y     Position of the overlay, 0,0 by default
+        --batch list         Do the job for every basename and image.ppm
+                             line in list, leaving both off the command
+        --yuv-matrix 601|709 Colors of --yuv as BT.601, the default, or BT.709
+        --yuv-range full     Full range --yuv, rather than 16 to 235
+        --profile            Print the time and hardware counters of every
+                             stage: header, decode, option, encode and I/O
     @endverbatim
   *
   * @par Modifications and Development Timeline:
@@ -60,8 +109,31 @@
   *
   *****************************************************************************/
 #include <iostream>
+#include <iomanip>
 #include <fstream>
 #include <string>
+#include <cstring>
+#include <climits>
+#include <cctype>
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <sstream>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <chrono>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+#include <algorithm>
 
 using namespace std;
 
@@ -106,7 +178,7 @@ struct image
     * @par Description
     * Integer that contains image rows.
     ************************************************************************/
-    int rows;
+    int rows = 0;
 
     /** **********************************************************************
     * @author Steve Nathan de Sa
@@ -114,7 +186,7 @@ struct image
     * @par Description
     * Integer that contains image columns.
     ************************************************************************/
-    int cols;
+    int cols = 0;
 
     /** **********************************************************************
     * @author Steve Nathan de Sa
@@ -122,7 +194,7 @@ struct image
     * @par Description
     * 2d dynamic array of type pixel that contains Red pixels.
     ************************************************************************/
-    pixel** redGray;
+    pixel** redGray = nullptr;
 
     /** **********************************************************************
     * @author Steve Nathan de Sa
@@ -130,7 +202,7 @@ struct image
     * @par Description
     * 2d dynamic array of type pixel that contains Green pixels.
     ************************************************************************/
-    pixel** green;
+    pixel** green = nullptr;
 
     /** **********************************************************************
     * @author Steve Nathan de Sa
@@ -138,28 +210,636 @@ struct image
     * @par Description
     * 2d dynamic array of type pixel that contains Blue pixels.
     ************************************************************************/
-    pixel** blue;
+    pixel** blue = nullptr;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * 2d dynamic array of type pixel that contains Alpha pixels, 0 for
+    * transparent and 255 for opaque, or nullptr if the image has no alpha.
+    ************************************************************************/
+    pixel** alpha = nullptr;
+};
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Largest number of pixels an image may have. Three samples per pixel must
+* still fit in an int.
+************************************************************************/
+const long long MAX_IMAGE_PIXELS = 0x7fffffff / 3;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Width and height of the square tiles used by the cache blocked
+* operations.
+************************************************************************/
+const int TILE_SIZE = 64;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Structure that describes the area of an image covered by one tile.
+************************************************************************/
+struct tileRect
+{
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * First image row of the tile.
+    ************************************************************************/
+    int row;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * First image column of the tile.
+    ************************************************************************/
+    int col;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Number of rows in the tile, TILE_SIZE except on the bottom edge.
+    ************************************************************************/
+    int rows;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Number of columns in the tile, TILE_SIZE except on the right edge.
+    ************************************************************************/
+    int cols;
+};
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Structure that stores the per channel statistics of an image. Channel 0
+* is red, 1 is green and 2 is blue.
+************************************************************************/
+struct imageStats
+{
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Number of pixels holding each of the 256 values, per channel.
+    ************************************************************************/
+    long long histogram[3][256];
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Number of pixels counted into the histograms.
+    ************************************************************************/
+    long long count;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Smallest value of each channel.
+    ************************************************************************/
+    int min[3];
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Largest value of each channel.
+    ************************************************************************/
+    int max[3];
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Mean value of each channel.
+    ************************************************************************/
+    double mean[3];
+};
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Extensions of every kind of file the program can write, in the order
+* outputName gives them, ending with nullptr. The cache only looks for
+* results with these extensions, so every output type must be listed.
+************************************************************************/
+const char* const OUTPUT_EXTENSIONS[] = { ".ppm", ".pgm", ".pbm", ".tpi", ".pam", ".yuv", nullptr };
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Structure that stores the ways of saving memory chosen by planMemory to
+* keep a run under the memory limit.
+************************************************************************/
+struct memoryPlan
+{
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Ascii pixel data is parsed straight from the stream on one thread
+    * instead of being gathered and parsed in parallel.
+    ************************************************************************/
+    bool sequentialDecode = false;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Rotations and transposes assign and fill one new plane at a time.
+    ************************************************************************/
+    bool planeAtATime = false;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Rotations and transposes write the planes not being worked on to a
+    * temporary file, so at most two planes are in memory.
+    ************************************************************************/
+    bool spillPlanes = false;
+};
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Structure that stores the global options given in front of the option
+* code on the command line.
+************************************************************************/
+struct settings
+{
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Directory of the result cache, empty when the cache is not used.
+    ************************************************************************/
+    string cacheDir;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Largest total size of the result cache in bytes.
+    ************************************************************************/
+    long long cacheLimit = 1LL << 30;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Most memory in bytes a run should use, 0 for no limit.
+    ************************************************************************/
+    long long memoryLimit = 0;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Large planes are placed on explicit huge pages when the system has
+    * them, not only on transparent ones.
+    ************************************************************************/
+    bool hugePages = false;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Image blended on top by --overlay, and the column and row of the
+    * image its top left corner goes to, which may be negative.
+    ************************************************************************/
+    string overlayFile;
+    int overlayX = 0;
+    int overlayY = 0;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Number of levels written by --pyramid.
+    ************************************************************************/
+    int pyramidLevels = 0;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Method of --dither, fs for Floyd Steinberg or bayer for ordered.
+    ************************************************************************/
+    string ditherMode;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Matrix of --yuv output, 601 or 709, and whether it uses the full range
+    * of 0 to 255 rather than the limited range of video.
+    ************************************************************************/
+    int yuvMatrix = 601;
+    bool yuvFull = false;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * List of the jobs of a batch, one basename and input file a line, or
+    * empty for a single job given on the command line.
+    ************************************************************************/
+    string batchFile;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Every stage of the job is timed and counted, and a profile printed
+    * at the end.
+    ************************************************************************/
+    bool profile = false;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Ways of saving memory chosen to stay under memoryLimit.
+    ************************************************************************/
+    memoryPlan plan;
+};
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Global options of the current run, filled in by main.
+************************************************************************/
+extern settings config;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Tasks handed to the work stealing scheduler together, which can be
+* waited on as one.
+************************************************************************/
+struct taskGroup
+{
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Number of tasks of the group that have not finished.
+    ************************************************************************/
+    atomic<int> pending{ 0 };
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Number of tasks of the group still waiting in a queue.
+    ************************************************************************/
+    atomic<int> queued{ 0 };
+};
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Number of bytes moved between a file and its prefetch or write behind
+* buffer at a time.
+************************************************************************/
+const size_t IO_CHUNK_SIZE = 1 << 20;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Number of chunks a prefetch or write behind buffer keeps in flight.
+************************************************************************/
+const int IO_DEPTH = 4;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Number of bands of rows in flight between the decode, option and encode
+* stages of a pipelined job, and the bytes of pixels in a band.
+************************************************************************/
+const int PIPE_BANDS = 4;
+const size_t PIPE_BAND_BYTES = 4 << 20;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Stream buffer that reads another stream buffer ahead on its own thread,
+* so that the parser works on one chunk while the next ones are being read
+* from the disk.
+************************************************************************/
+class prefetchBuf : public streambuf
+{
+public:
+    prefetchBuf(streambuf* source, size_t chunkSize = IO_CHUNK_SIZE,
+        int depth = IO_DEPTH);
+    ~prefetchBuf();
+
+    size_t peek(const char*& data);
+    void consume(size_t count);
+
+protected:
+    int_type underflow() override;
+
+private:
+    void fill();
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Stream buffer the chunks are read from.
+    ************************************************************************/
+    streambuf* source;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Number of bytes in every chunk.
+    ************************************************************************/
+    size_t chunkSize;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Chunk storage, and the number of bytes read into each chunk.
+    ************************************************************************/
+    vector<vector<char>> buffers;
+    vector<size_t> lengths;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Chunks read and waiting to be parsed, in file order, and chunks free
+    * to be read into.
+    ************************************************************************/
+    deque<int> ready;
+    deque<int> empty;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Chunk being parsed, or -1 for none.
+    ************************************************************************/
+    int current;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Set once the source has run out, and when the buffer is destroyed.
+    ************************************************************************/
+    bool finished;
+    bool stopping;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Guards the chunk lists, and wakes either thread when they change.
+    ************************************************************************/
+    mutex lock;
+    condition_variable changed;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Thread that reads the chunks.
+    ************************************************************************/
+    thread reader;
+};
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Stream buffer that writes to another stream buffer on its own thread, so
+* that the encoder fills one chunk while the previous ones are being written
+* to the disk.
+************************************************************************/
+class writeBehindBuf : public streambuf
+{
+public:
+    writeBehindBuf(streambuf* sink, size_t chunkSize = IO_CHUNK_SIZE,
+        int depth = IO_DEPTH);
+    ~writeBehindBuf();
+
+protected:
+    int_type overflow(int_type c) override;
+    int sync() override;
+
+private:
+    void drain();
+    void submit();
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Stream buffer the chunks are written to.
+    ************************************************************************/
+    streambuf* sink;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Number of bytes in every chunk.
+    ************************************************************************/
+    size_t chunkSize;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Chunk storage, and the number of bytes filled in each chunk.
+    ************************************************************************/
+    vector<vector<char>> buffers;
+    vector<size_t> lengths;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Chunks filled and waiting to be written, in order, and chunks free to
+    * be filled.
+    ************************************************************************/
+    deque<int> full;
+    deque<int> empty;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Chunk being filled.
+    ************************************************************************/
+    int current;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Set when a write to the sink came up short, and when the buffer is
+    * destroyed. failed is read by the encoder without the lock, so it is
+    * atomic.
+    ************************************************************************/
+    atomic<bool> failed;
+    bool stopping;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Guards the chunk lists, and wakes either thread when they change.
+    ************************************************************************/
+    mutex lock;
+    condition_variable changed;
+
+    /** **********************************************************************
+    * @author Steve Nathan de Sa
+    *
+    * @par Description
+    * Thread that writes the chunks.
+    ************************************************************************/
+    thread writer;
 };
 
 void openIPFile(ifstream& file, string filename);
 void openOPFile(ofstream& file, string filename);
+streambuf* openInput(ifstream& file, string filename);
+streambuf* openOutput(ofstream& file, string filename);
 
-bool readImage(ifstream& fin, image& img);
+bool readHeader(istream& fin, image& img, int& maxval, int* depth = nullptr);
+bool readImage(ifstream& fin, image& img, imageStats* stats = nullptr);
+bool readImage(istream& fin, image& img, imageStats* stats = nullptr);
+bool readPlanarHeader(istream& fin, image& img);
+bool readPlanar(istream& fin, image& img);
+void writePlanar(ostream& out, image& img);
+size_t lz4Bound(size_t length);
+size_t lz4Compress(const pixel* src, size_t length, pixel* dst);
+bool lz4Decompress(const pixel* src, size_t length, pixel* dst, size_t size);
+bool nextFrame(istream& fin);
+string outputName(image& img, string filename);
+void writeHeader(ostream& out, image& img);
+void writeImageData(ostream& out, image& img);
+void writePixelData(ostream& out, image& img);
 void writeImage(ofstream& fout, image& img, string filename);
+void writeYUV(ostream& out, image& img);
+bool singlePixmap(ifstream& fin, image& img);
+bool streamMirror(string option, string type, string& output, string input);
+bool canPipeline(string option, string type);
+bool pipelineImage(string option, string type, string& output, string input);
 
 void allocarray(pixel**& array, int rows, int columns);
+void resizeimage(image& img, int oldRows, int oldCols);
 void freearray(pixel**& array, int rows);
+void freeimage(image& img);
+void trackMemory(long long bytes);
+long long peakMemory();
+bool planMemory(ostream& log, string option, string type, string input);
+void reportMemory(ostream& log);
+
+int tileCount(int rows, int cols);
+tileRect tileAt(int rows, int cols, int index);
+
+int rowKernels();
+bool checkRowKernels(int kernels);
+void reverseRow(pixel* row, int count);
+void reverseRowRGB(pixel* dst, const pixel* src, int count);
+void packBits(pixel* dst, const pixel* src, int count);
 
 void flipX(image& img, string type);
 void flipY(image& img, string type);
 
 void rotateCW(image& img, string type);
 void rotateCCW(image& img, string type);
+void rotate180(image& img, string type);
+void transpose(image& img, string type);
+void transverse(image& img, string type);
 
 void grayscale(image& img, string type);
 void sepia(image& img, string type);
 
+void blendRow(pixel* dst, const pixel* src, const pixel* alpha, int count);
+void overlay(image& img, string type);
+
+void pyramid(image& img, string type, string basename);
+
+void dither(image& img, string type);
+
+int compareImages(string mode, string reference, string candidate);
+int verifyGoldens(string dir, string baselineFile);
+
+void profileThread();
+void endStage();
+void beginStage(string name);
+void nextStage(string from, string to);
+void stageBytes(image& img);
+void printProfile(ostream& log);
+
+void clearStats(imageStats& stats);
+void finishStats(imageStats& stats);
+void mergeStats(imageStats& stats, const imageStats& part);
+void computeStats(image& img, imageStats& stats);
+void printStats(ostream& out, imageStats& stats);
+void applyLUT(image& img, pixel lut[3][256]);
+
+void statistics(image& img, string type, imageStats* stats = nullptr);
+void autolevels(image& img, string type, imageStats* stats = nullptr);
+
+int threadCount();
+int bandCount(int rows);
+void parallelBands(int rows, const function<void(int, int, int)>& body);
+void runTask(taskGroup& group, function<void()> task);
+void waitTasks(taskGroup& group);
+
+void setOutputType(image& img, string type, bool gray);
 int edit(double value);
 void error(string type);
 
+bool isOption(string option);
+long long parseSize(string text);
+void applyOption(string option, image& img, string type, imageStats* stats);
+string processFrames(string option, string type, string output, string input);
+string jobKey(string option, string type, string input);
+bool runJob(string option, string type, string output, string input);
+bool runBatch(string option, string type, string list);
+
+unsigned long long hashBytes(const char* data, size_t length, unsigned long long seed);
+string cacheKey(string input, string option, string type);
+bool linkOrCopy(string from, string to);
+string cacheFind(string dir, string key);
+bool cacheLookup(string dir, string key, string output);
+void cacheStore(string dir, string key, string file, long long limit);
+void cacheEvict(string dir, long long limit);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,205 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+//BLEND A ROW
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function blends a row of a premultiplied overlay on top of a row of a
+ * plane, out = src + dst * (255 - alpha) / 255. As src is already multiplied
+ * by alpha, the sum never passes 255. The division by 255 is done with
+ * shifts, (x + 128 + ((x + 128) >> 8)) >> 8, which rounds exactly as
+ * round(x / 255.0) does for every product of two samples. With SSE2, 16
+ * pixels are blended at a time in 16 bit lanes, and the rest one at a time.
+ *
+ * @param[in, out]  dst - row of the plane to blend onto.
+ * @param[in]       src - row of the premultiplied overlay plane.
+ * @param[in]       alpha - row of the overlay alpha plane.
+ * @param[in]       count - number of pixels to blend.
+ *
+ * @par Example
+ * @verbatim
+   blendRow(img.redGray[i] + x, over.redGray[i - y], over.alpha[i - y], width);
+   @endverbatim
+ *****************************************************************************/
+void blendRow(pixel* dst, const pixel* src, const pixel* alpha, int count)
+{
+    int j = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i half = _mm_set1_epi16(128);
+
+    for (; j + 16 <= count; j += 16)
+    {
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + j));
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + j));
+        __m128i a = _mm_loadu_si128((const __m128i*)(alpha + j));
+
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero),
+            _mm_sub_epi16(full, _mm_unpacklo_epi8(a, zero))), half);
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero),
+            _mm_sub_epi16(full, _mm_unpackhi_epi8(a, zero))), half);
+
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+        _mm_storeu_si128((__m128i*)(dst + j), _mm_adds_epu8(_mm_packus_epi16(lo, hi), s));
+    }
+#endif
+
+    for (; j < count; j++)
+    {
+        int x = dst[j] * (255 - alpha[j]) + 128;
+
+        dst[j] = pixel(src[j] + ((x + (x >> 8)) >> 8));
+    }
+}
+
+//LOAD OVERLAY
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function returns the overlay image in the file, ready to blend: its
+ * colors multiplied by its alpha, and an opaque alpha plane given to it if it
+ * has none. Each file is read and prepared once and kept for the rest of the
+ * run, so every frame of a stream and every job of a batch blends the same
+ * overlay without reading it again. The program ends with a message if the
+ * file cannot be read.
+ *
+ * @param[in]  filename - name of the overlay file.
+ *
+ * @return the prepared overlay.
+ *
+ * @par Example
+ * @verbatim
+   image& over = loadOverlay("logo.pam");
+   @endverbatim
+ *****************************************************************************/
+static image& loadOverlay(string filename)
+{
+    static map<string, image> overlays;
+    static mutex overlayLock;
+
+    //JOBS OF A BATCH MAY ASK FOR THE SAME OVERLAY AT ONCE
+    lock_guard<mutex> guard(overlayLock);
+    auto found = overlays.find(filename);
+
+    if (found != overlays.end())
+    {
+        return found->second;
+    }
+
+    image& over = overlays[filename];
+    ifstream fin;
+
+    openIPFile(fin, filename);
+
+    if (!readImage(fin, over))
+    {
+        cout << "Unable to read the overlay file: " << filename << endl;
+        exit(0);
+    }
+
+    if (over.alpha == nullptr)
+    {
+        allocarray(over.alpha, over.rows, over.cols);
+
+        parallelBands(over.rows, [&](int, int first, int last)
+        {
+            for (int i = first; i < last; i++)
+            {
+                memset(over.alpha[i], 255, over.cols);
+            }
+        });
+    }
+
+    parallelBands(over.rows, [&](int, int first, int last)
+    {
+        for (int i = first; i < last; i++)
+        {
+            for (int j = 0; j < over.cols; j++)
+            {
+                int a = over.alpha[i][j];
+                int r = over.redGray[i][j] * a + 128;
+                int g = over.green[i][j] * a + 128;
+                int b = over.blue[i][j] * a + 128;
+
+                over.redGray[i][j] = pixel((r + (r >> 8)) >> 8);
+                over.green[i][j] = pixel((g + (g >> 8)) >> 8);
+                over.blue[i][j] = pixel((b + (b >> 8)) >> 8);
+            }
+        }
+    });
+
+    return over;
+}
+
+//OVERLAY
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function blends the overlay file given with --overlay-file on top of
+ * the image, with its top left corner at the column and row given with
+ * --overlay-at. The parts of the overlay outside the image are left out.
+ * If the image has an alpha channel, the overlay is blended onto it too, so
+ * the result is as opaque as the two layers together. The bands of rows
+ * under the overlay are blended on separate threads.
+ *
+ * @param[in, out]  img - defined image structure to edit.
+ * @param[in]       type - contains type of output file needed.
+ *
+ * @par Example
+ * @verbatim
+   config.overlayFile = "logo.pam";
+   config.overlayX = 10;
+   config.overlayY = 20;
+   overlay(img, "--pam");
+   @endverbatim
+ *****************************************************************************/
+void overlay(image& img, string type)
+{
+    image& over = loadOverlay(config.overlayFile);
+    int left = max(config.overlayX, 0);
+    int top = max(config.overlayY, 0);
+    int right = min(config.overlayX + over.cols, img.cols);
+    int bottom = min(config.overlayY + over.rows, img.rows);
+
+    setOutputType(img, type, false);
+
+    if (left >= right || top >= bottom)
+    {
+        return;
+    }
+
+    int width = right - left;
+    int skip = left - config.overlayX;
+
+    parallelBands(bottom - top, [&](int, int first, int last)
+    {
+        for (int i = top + first; i < top + last; i++)
+        {
+            int row = i - config.overlayY;
+            const pixel* alpha = over.alpha[row] + skip;
+
+            blendRow(img.redGray[i] + left, over.redGray[row] + skip, alpha, width);
+            blendRow(img.green[i] + left, over.green[row] + skip, alpha, width);
+            blendRow(img.blue[i] + left, over.blue[row] + skip, alpha, width);
+
+            if (img.alpha != nullptr)
+            {
+                blendRow(img.alpha[i] + left, alpha, alpha, width);
+            }
+        }
+    });
+}
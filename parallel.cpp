@@ -0,0 +1,387 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* A task waiting to run, with the group it belongs to, so a thread waiting
+* on a group can pick out the tasks of that group.
+************************************************************************/
+struct queuedTask
+{
+    taskGroup* group;
+    function<void()> run;
+};
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Tasks waiting to run on one worker of the scheduler. The worker takes
+* its own tasks from the back, newest first, while idle workers steal from
+* the front, taking the oldest and usually largest pieces of work.
+************************************************************************/
+struct taskQueue
+{
+    mutex lock;
+    deque<queuedTask> tasks;
+};
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* State of the work stealing scheduler: one queue per worker, the number
+* of tasks in all queues, and a condition that wakes the workers when that
+* number grows or when a group finishes. Queue 0 belongs to no worker: it
+* takes the tasks of threads outside the scheduler, such as the main
+* thread and the pipeline threads, and the workers steal from its front.
+************************************************************************/
+struct taskScheduler
+{
+    vector<taskQueue> queues;
+    atomic<int> queued{ 0 };
+    mutex idleLock;
+    condition_variable idle;
+};
+
+//SCHEDULER STATE
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* The scheduler is created with the workers on the first task and never
+* freed, as the workers wait on it until the program ends. self is the
+* number of the worker running the calling thread, or -1 for a thread
+* outside the scheduler.
+************************************************************************/
+static taskScheduler* scheduler = nullptr;
+static once_flag started;
+static thread_local int self = -1;
+
+//NUMBER OF WORKER THREADS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function returns the number of threads the image operations may use,
+ * which is the number of hardware threads on the machine, or 1 if that
+ * cannot be determined.
+ *
+ * @return number of worker threads, at least 1.
+ *
+ * @par Example
+ * @verbatim
+   int n = threadCount(); //8 on a quad core machine with hyperthreading
+   @endverbatim
+ *****************************************************************************/
+int threadCount()
+{
+    unsigned int n = thread::hardware_concurrency();
+
+    if (n == 0)
+    {
+        return 1;
+    }
+
+    return int(n);
+}
+
+//NUMBER OF ROW BANDS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function returns how many row bands parallelBands will split an image
+ * of the given number of rows into. Callers use it to size per band storage,
+ * such as thread local histograms, before running the bands.
+ *
+ * @param[in]  rows - number of rows in the image.
+ *
+ * @return number of bands, between 1 and rows.
+ *
+ * @par Example
+ * @verbatim
+   int bands = bandCount(img.rows);
+   vector<long long> sums(bands, 0); //one partial sum per band
+   @endverbatim
+ *****************************************************************************/
+int bandCount(int rows)
+{
+    int n = threadCount();
+
+    if (rows < n)
+    {
+        n = rows;
+    }
+
+    if (n < 1)
+    {
+        n = 1;
+    }
+
+    return n;
+}
+
+//TAKE A TASK
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function takes the next task for the calling thread: the newest of
+ * its own queue, or else the oldest of the first other queue that has one.
+ * A thread outside the scheduler has no queue of its own, so it only
+ * takes the oldest tasks. When a group is given, only tasks of that group
+ * are taken, so a thread waiting on a group never runs unrelated work,
+ * such as another job of a batch, before it can return.
+ *
+ * @param[out]  task - the task taken.
+ * @param[in]   group - group to take tasks of, or nullptr for any.
+ *
+ * @return true if a task was taken, false if no queue has one.
+ *
+ * @par Example
+ * @verbatim
+   function<void()> task;
+   while (takeTask(task, &group))
+   {
+       task();
+   }
+   @endverbatim
+ *****************************************************************************/
+static bool takeTask(function<void()>& task, taskGroup* group)
+{
+    int count = int(scheduler->queues.size());
+    int start = max(self, 0);
+    int k;
+
+    for (k = 0; k < count; k++)
+    {
+        taskQueue& queue = scheduler->queues[(start + k) % count];
+        bool own = k == 0 && self >= 0;
+        lock_guard<mutex> guard(queue.lock);
+        size_t n = queue.tasks.size();
+
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t at = own ? n - 1 - i : i;
+
+            if (group != nullptr && queue.tasks[at].group != group)
+            {
+                continue;
+            }
+
+            task = move(queue.tasks[at].run);
+            queue.tasks[at].group->queued--;
+            queue.tasks.erase(queue.tasks.begin() + at);
+            scheduler->queued--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//WORKER LOOP
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function is run by every worker of the scheduler. It runs tasks as
+ * long as there are any, and sleeps until more are queued.
+ *
+ * @param[in]  index - number of the worker and of its queue.
+ *
+ * @par Example
+ * @verbatim
+   thread(workLoop, 1).detach();
+   @endverbatim
+ *****************************************************************************/
+static void workLoop(int index)
+{
+    function<void()> task;
+
+    self = index;
+    profileThread();
+
+    while (true)
+    {
+        if (takeTask(task, nullptr))
+        {
+            task();
+            continue;
+        }
+
+        unique_lock<mutex> guard(scheduler->idleLock);
+        scheduler->idle.wait(guard, [] { return scheduler->queued > 0; });
+    }
+}
+
+//START THE SCHEDULER
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function creates queue 0 for the threads outside the scheduler and
+ * a queue for every worker, and starts one worker fewer than threadCount,
+ * as the thread waiting on a group of tasks runs tasks too. It is called
+ * once, on the first task.
+ *
+ * @par Example
+ * @verbatim
+   call_once(started, startScheduler);
+   @endverbatim
+ *****************************************************************************/
+static void startScheduler()
+{
+    int i;
+    int workers = threadCount();
+
+    scheduler = new taskScheduler;
+    scheduler->queues = vector<taskQueue>(workers);
+
+    for (i = 1; i < workers; i++)
+    {
+        thread(workLoop, i).detach();
+    }
+}
+
+//RUN A TASK
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function hands a task to the work stealing scheduler as part of a
+ * group. The task goes on the queue of the calling worker, so tasks made
+ * while running a task stay with its worker unless another worker is idle
+ * and steals them. A thread outside the scheduler puts its tasks on queue
+ * 0, where the workers steal them. A large image split into bands is thereby shared out
+ * among the workers, while the bands of a small one usually run on the
+ * worker that made them, as one piece of work.
+ *
+ * @param[in, out]  group - group the task belongs to.
+ * @param[in]       task - work to do, which must not throw.
+ *
+ * @par Example
+ * @verbatim
+   taskGroup jobs;
+   runTask(jobs, [] { processFrames("--sepia", "--binary", "a", "a.ppm"); });
+   runTask(jobs, [] { processFrames("--sepia", "--binary", "b", "b.ppm"); });
+   waitTasks(jobs);
+   @endverbatim
+ *****************************************************************************/
+void runTask(taskGroup& group, function<void()> task)
+{
+    call_once(started, startScheduler);
+
+    group.pending++;
+
+    {
+        taskQueue& queue = scheduler->queues[max(self, 0)];
+        lock_guard<mutex> guard(queue.lock);
+
+        queue.tasks.push_back({ &group, [&group, task]
+        {
+            task();
+
+            //THE WAITING THREAD MAY RETURN AND DESTROY THE GROUP RIGHT AFTER THIS
+            if (--group.pending == 0)
+            {
+                lock_guard<mutex> guard(scheduler->idleLock);
+                scheduler->idle.notify_all();
+            }
+        } });
+        group.queued++;
+    }
+
+    scheduler->queued++;
+
+    //ALL ARE WOKEN, AS A THREAD WAITING ON THIS GROUP MAY NOT BE A WORKER
+    {
+        lock_guard<mutex> guard(scheduler->idleLock);
+    }
+
+    scheduler->idle.notify_all();
+}
+
+//WAIT FOR TASKS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function returns once every task of the group has finished. While
+ * waiting, the calling thread runs the queued tasks of the group itself,
+ * its own first and then stolen ones. Tasks of other groups are left to
+ * the workers, so a wait is never held up by unrelated work.
+ *
+ * @param[in, out]  group - group to wait for.
+ *
+ * @par Example
+ * @verbatim
+   waitTasks(jobs); //every job has been written
+   @endverbatim
+ *****************************************************************************/
+void waitTasks(taskGroup& group)
+{
+    function<void()> task;
+
+    while (group.pending > 0)
+    {
+        if (takeTask(task, &group))
+        {
+            task();
+            continue;
+        }
+
+        unique_lock<mutex> guard(scheduler->idleLock);
+        scheduler->idle.wait(guard, [&] { return group.queued > 0 || group.pending == 0; });
+    }
+}
+
+//RUN ROW BANDS IN PARALLEL
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function splits the rows of an image into bandCount(rows) contiguous
+ * bands of nearly equal height and calls body once for every band. The
+ * first band runs on the calling thread and the others are handed to the
+ * work stealing scheduler, so idle workers pick them up. The function
+ * returns once every band has finished.
+ *
+ * @param[in]  rows - number of rows in the image.
+ * @param[in]  body - called as body(band, first, last) to process the rows
+ *                    first up to but not including last.
+ *
+ * @par Example
+ * @verbatim
+   parallelBands(img.rows, [&](int, int first, int last)
+   {
+       for (int i = first; i < last; i++)
+       {
+           //process row i
+       }
+   });
+   @endverbatim
+ *****************************************************************************/
+void parallelBands(int rows, const function<void(int, int, int)>& body)
+{
+    int i;
+    int bands = bandCount(rows);
+    taskGroup group;
+
+    for (i = 1; i < bands; i++)
+    {
+        int first = int((long long)rows * i / bands);
+        int last = int((long long)rows * (i + 1) / bands);
+
+        runTask(group, [&body, i, first, last] { body(i, first, last); });
+    }
+
+    body(0, 0, int((long long)rows / bands));
+
+    waitTasks(group);
+}
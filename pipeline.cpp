@@ -0,0 +1,294 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Bands of a pipelined job on their way between the stages. Every band
+* image is in exactly one queue, or being worked on by one stage: empty
+* bands wait for the decoder, decoded ones for the option and processed
+* ones for the encoder, which hands them back as empty. -1 in a queue
+* marks the end of the image. As there are only PIPE_BANDS band images,
+* a stage that runs ahead waits for the one behind it.
+************************************************************************/
+struct bandPipe
+{
+    mutex lock;
+    condition_variable changed;
+    deque<int> empty;
+    deque<int> decoded;
+    deque<int> processed;
+    bool failed = false;
+};
+
+//TAKE A BAND
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function waits for a band in one of the queues of a pipe and takes
+ * it off the front.
+ *
+ * @param[in, out]  pipe - pipe the queue belongs to.
+ * @param[in, out]  queue - queue to take from.
+ *
+ * @return index of the band, or -1 at the end of the image.
+ *
+ * @par Example
+ * @verbatim
+   int k = takeBand(pipe, pipe.decoded);
+   @endverbatim
+ *****************************************************************************/
+static int takeBand(bandPipe& pipe, deque<int>& queue)
+{
+    unique_lock<mutex> guard(pipe.lock);
+    pipe.changed.wait(guard, [&] { return !queue.empty(); });
+
+    int k = queue.front();
+
+    queue.pop_front();
+
+    return k;
+}
+
+//GIVE A BAND
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function puts a band at the back of one of the queues of a pipe and
+ * wakes the stage waiting on it.
+ *
+ * @param[in, out]  pipe - pipe the queue belongs to.
+ * @param[in, out]  queue - queue to add to.
+ * @param[in]       k - index of the band, or -1 for the end of the image.
+ *
+ * @par Example
+ * @verbatim
+   giveBand(pipe, pipe.processed, k);
+   @endverbatim
+ *****************************************************************************/
+static void giveBand(bandPipe& pipe, deque<int>& queue, int k)
+{
+    {
+        lock_guard<mutex> guard(pipe.lock);
+        queue.push_back(k);
+    }
+
+    pipe.changed.notify_all();
+}
+
+//CAN PIPELINE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function checks whether a job can be pipelined: the option must
+ * change every row on its own, and the output type must write every row
+ * on its own. Options that move rows, such as --flipX and the rotations,
+ * or that need the whole image first, such as --autolevels, cannot.
+ *
+ * @param[in]  option - option code given on the command line.
+ * @param[in]  type - contains type of output file needed.
+ *
+ * @return true if the job can be worked a band of rows at a time.
+ *
+ * @par Example
+ * @verbatim
+   canPipeline("--sepia", "--binary"); //true
+   canPipeline("--rotateCW", "--binary"); //false
+   @endverbatim
+ *****************************************************************************/
+bool canPipeline(string option, string type)
+{
+    return (option.empty() || option == "--flipY" || option == "--grayscale" ||
+        option == "--sepia") && (type == "--ascii" || type == "--binary" || type == "--pam");
+}
+
+//PIPELINED JOB
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function does a job on a binary ppm file as a pipeline of three
+ * stages, each on its own thread, passing bands of rows from one to the
+ * next: one thread reads and decodes a band, the next applies the option
+ * to the band before it, and this thread encodes and writes the band
+ * before that. So decoding, the option and encoding all run at once, and
+ * only PIPE_BANDS bands are ever held instead of the whole image. The
+ * option and encoder still split each band among the worker threads where
+ * they do so for a whole image.
+ *
+ * This only works for a file holding a single P6 image with a maximum value
+ * of 255, and for an option and output type accepted by canPipeline. For
+ * anything else, including standard input, nothing is written and false is
+ * returned, so the caller can fall back to reading the whole image. If the
+ * pixel data cannot all be read after all, as when the file shrinks while
+ * it is read, the part of the output written is removed, output is set to
+ * an empty string and true is returned, as the job is over.
+ *
+ * @param[in]       option - option code given on the command line.
+ * @param[in]       type - contains type of output file needed.
+ * @param[in, out]  output - base name of the output file, given its
+ *                           extension when the image is written.
+ * @param[in]       input - name of the input file.
+ *
+ * @return true if the job was done, written or failed.
+ *
+ * @par Example
+ * @verbatim
+   string output = "antique";
+   if (pipelineImage("--sepia", "--binary", output, "big.ppm"))
+   {
+       cout << "Wrote " << output; //antique.ppm
+   }
+   @endverbatim
+ *****************************************************************************/
+bool pipelineImage(string option, string type, string& output, string input)
+{
+    ifstream fin;
+    ofstream fout;
+    image img;
+    bandPipe pipe;
+    int k;
+
+    if (!canPipeline(option, type) || input == "-")
+    {
+        return false;
+    }
+
+    openIPFile(fin, input);
+
+    if (!singlePixmap(fin, img))
+    {
+        return false;
+    }
+
+    nextStage("open input", "pipeline");
+    stageBytes(img);
+
+    size_t rowBytes = size_t(img.cols) * 3;
+    int bandRows = int(min(size_t(img.rows), max(size_t(1), PIPE_BAND_BYTES / rowBytes)));
+    vector<image> bands(PIPE_BANDS);
+
+    for (k = 0; k < PIPE_BANDS; k++)
+    {
+        allocarray(bands[k].redGray, bandRows, img.cols);
+        allocarray(bands[k].green, bandRows, img.cols);
+        allocarray(bands[k].blue, bandRows, img.cols);
+        bands[k].cols = img.cols;
+        bands[k].comment = img.comment;
+        pipe.empty.push_back(k);
+    }
+
+    //READS AND DECODES THE BANDS IN ORDER
+    thread decoder([&]
+    {
+        vector<pixel> block(rowBytes * bandRows);
+
+        profileThread();
+        trackMemory((long long)block.size());
+
+        for (int first = 0; first < img.rows; first += bandRows)
+        {
+            int count = min(bandRows, img.rows - first);
+            int b = takeBand(pipe, pipe.empty);
+            image& band = bands[b];
+            const pixel* bvalues = block.data();
+
+            if (!fin.read((char*)block.data(), streamsize(rowBytes * count)))
+            {
+                pipe.failed = true;
+                break;
+            }
+
+            for (int i = 0; i < count; i++)
+            {
+                for (int j = 0; j < img.cols; j++)
+                {
+                    band.redGray[i][j] = *bvalues++;
+                    band.green[i][j] = *bvalues++;
+                    band.blue[i][j] = *bvalues++;
+                }
+            }
+
+            band.rows = count;
+            band.magicNumber = "P6";
+            giveBand(pipe, pipe.decoded, b);
+        }
+
+        trackMemory(-(long long)block.size());
+        giveBand(pipe, pipe.decoded, -1);
+    });
+
+    //APPLIES THE OPTION TO EACH DECODED BAND
+    thread processor([&]
+    {
+        int b;
+
+        profileThread();
+
+        while ((b = takeBand(pipe, pipe.decoded)) >= 0)
+        {
+            applyOption(option, bands[b], type, nullptr);
+            giveBand(pipe, pipe.processed, b);
+        }
+
+        giveBand(pipe, pipe.processed, -1);
+    });
+
+    //THE FIRST BAND GIVES THE OUTPUT TYPE, AND SO THE HEADER AND FILE NAME
+    k = takeBand(pipe, pipe.processed);
+
+    if (k >= 0)
+    {
+        image whole;
+
+        whole.rows = img.rows;
+        whole.cols = img.cols;
+        whole.comment = img.comment;
+        whole.magicNumber = bands[k].magicNumber;
+
+        output = outputName(whole, output);
+
+        writeBehindBuf behind(openOutput(fout, output));
+        ostream out(&behind);
+
+        writeHeader(out, whole);
+
+        while (k >= 0)
+        {
+            writePixelData(out, bands[k]);
+            giveBand(pipe, pipe.empty, k);
+            k = takeBand(pipe, pipe.processed);
+        }
+
+        out.flush();
+    }
+
+    decoder.join();
+    processor.join();
+    fout.close();
+
+    for (k = 0; k < PIPE_BANDS; k++)
+    {
+        freeimage(bands[k]);
+    }
+
+    if (pipe.failed)
+    {
+        cout << "Unable to read the image file: " << input << endl;
+
+        if (output != "-")
+        {
+            remove(output.c_str());
+        }
+
+        output = "";
+    }
+
+    return true;
+}
@@ -0,0 +1,669 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Number of entries in the LZ4 match finder hash table.
+************************************************************************/
+const int LZ4_HASH_BITS = 14;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* LZ4 rules: no match may start in the last 12 bytes of a block, and the
+* last 5 bytes are always literals.
+************************************************************************/
+const size_t LZ4_MATCH_LIMIT = 12;
+const size_t LZ4_LAST_LITERALS = 5;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Longest comment a planar file may hold. The length comes from the file,
+* so it is checked before anything is allocated for it.
+************************************************************************/
+const size_t MAX_COMMENT_LENGTH = 64 << 10;
+
+//WRITE 32 BIT VALUE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function writes a value as 4 little endian bytes.
+ *
+ * @param[in, out]  out - stream to write to.
+ * @param[in]       value - value to write.
+ *
+ * @par Example
+ * @verbatim
+   put32(out, img.cols);
+   @endverbatim
+ *****************************************************************************/
+static void put32(ostream& out, unsigned long long value)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        out.put(char((value >> (8 * i)) & 0xff));
+    }
+}
+
+//READ 32 BIT VALUE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads 4 little endian bytes as a value.
+ *
+ * @param[in, out]  in - stream to read from.
+ * @param[out]      value - the value read.
+ *
+ * @return true if all 4 bytes could be read.
+ *
+ * @par Example
+ * @verbatim
+   unsigned long long cols;
+   if (get32(fin, cols)) ...
+   @endverbatim
+ *****************************************************************************/
+static bool get32(istream& in, unsigned long long& value)
+{
+    unsigned char bytes[4];
+    int i;
+
+    if (!in.read((char*)bytes, 4))
+    {
+        return false;
+    }
+
+    value = 0;
+
+    for (i = 3; i >= 0; i--)
+    {
+        value = (value << 8) | bytes[i];
+    }
+
+    return true;
+}
+
+//LZ4 OUTPUT BOUND
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function returns the most bytes lz4Compress can produce from length
+ * bytes of input, which is what the output buffer must be able to hold.
+ *
+ * @param[in]  length - number of bytes to compress.
+ *
+ * @return size the output buffer needs.
+ *
+ * @par Example
+ * @verbatim
+   vector<pixel> packed(lz4Bound(size));
+   @endverbatim
+ *****************************************************************************/
+size_t lz4Bound(size_t length)
+{
+    return length + length / 255 + 16;
+}
+
+//WRITE LZ4 LENGTH
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function writes the part of a literal or match length that does not
+ * fit in its 4 bit token field, as a run of 255 bytes and a final byte.
+ *
+ * @param[in, out]  op - output position, moved past the bytes written.
+ * @param[in]       length - length minus the 15 held by the token.
+ *
+ * @par Example
+ * @verbatim
+   lz4Length(op, literals - 15);
+   @endverbatim
+ *****************************************************************************/
+static void lz4Length(pixel*& op, size_t length)
+{
+    while (length >= 255)
+    {
+        *op++ = 255;
+        length -= 255;
+    }
+
+    *op++ = pixel(length);
+}
+
+//LZ4 SEQUENCE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function writes one LZ4 sequence: a token, the literal bytes and, when
+ * matchLength is not 0, the offset and length of the match that follows them.
+ *
+ * @param[in, out]  op - output position, moved past the sequence.
+ * @param[in]       literals - first literal byte.
+ * @param[in]       count - number of literal bytes.
+ * @param[in]       offset - distance back to the match.
+ * @param[in]       matchLength - length of the match, 0 for the last sequence.
+ *
+ * @par Example
+ * @verbatim
+   lz4Sequence(op, src + anchor, ip - anchor, ip - ref, length);
+   @endverbatim
+ *****************************************************************************/
+static void lz4Sequence(pixel*& op, const pixel* literals, size_t count,
+    size_t offset, size_t matchLength)
+{
+    pixel* token = op++;
+    size_t extra = matchLength >= 4 ? matchLength - 4 : 0;
+
+    *token = pixel((count < 15 ? count : 15) << 4);
+
+    if (count >= 15)
+    {
+        lz4Length(op, count - 15);
+    }
+
+    memcpy(op, literals, count);
+    op += count;
+
+    if (matchLength == 0)
+    {
+        return;
+    }
+
+    *op++ = pixel(offset & 0xff);
+    *op++ = pixel(offset >> 8);
+
+    *token = pixel(*token | (extra < 15 ? extra : 15));
+
+    if (extra >= 15)
+    {
+        lz4Length(op, extra - 15);
+    }
+}
+
+//LZ4 COMPRESS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function compresses a block of bytes in the LZ4 block format. Each
+ * position is looked up by its next 4 bytes in a hash table of the last
+ * position seen with the same hash, which finds most repeats at very little
+ * cost. The output can be read by any LZ4 block decoder.
+ *
+ * @param[in]   src - bytes to compress.
+ * @param[in]   length - number of bytes.
+ * @param[out]  dst - output buffer of at least lz4Bound(length) bytes.
+ *
+ * @return number of bytes written to dst.
+ *
+ * @par Example
+ * @verbatim
+   vector<pixel> packed(lz4Bound(size));
+   packed.resize(lz4Compress(plane, size, packed.data()));
+   @endverbatim
+ *****************************************************************************/
+size_t lz4Compress(const pixel* src, size_t length, pixel* dst)
+{
+    vector<long long> table(size_t(1) << LZ4_HASH_BITS, -1);
+    pixel* op = dst;
+    size_t anchor = 0;
+    size_t ip = 0;
+
+    while (length > LZ4_MATCH_LIMIT && ip < length - LZ4_MATCH_LIMIT)
+    {
+        unsigned int sequence;
+        unsigned int hash;
+        long long ref;
+
+        memcpy(&sequence, src + ip, 4);
+        hash = (sequence * 2654435761U) >> (32 - LZ4_HASH_BITS);
+        ref = table[hash];
+        table[hash] = (long long)ip;
+
+        if (ref < 0 || ip - size_t(ref) > 65535 || memcmp(src + ref, src + ip, 4) != 0)
+        {
+            ip++;
+            continue;
+        }
+
+        size_t matchLength = 4;
+
+        while (ip + matchLength < length - LZ4_LAST_LITERALS &&
+            src[ref + matchLength] == src[ip + matchLength])
+        {
+            matchLength++;
+        }
+
+        lz4Sequence(op, src + anchor, ip - anchor, ip - size_t(ref), matchLength);
+
+        ip += matchLength;
+        anchor = ip;
+    }
+
+    lz4Sequence(op, src + anchor, length - anchor, 0, 0);
+
+    return size_t(op - dst);
+}
+
+//LZ4 DECOMPRESS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function expands a block in the LZ4 block format. Every length and
+ * offset is checked against the buffers, so a damaged file is reported as
+ * such instead of writing outside dst.
+ *
+ * @param[in]   src - compressed bytes.
+ * @param[in]   length - number of compressed bytes.
+ * @param[out]  dst - output buffer.
+ * @param[in]   size - exact number of bytes the block expands to.
+ *
+ * @return true if the block is valid and expands to exactly size bytes.
+ *
+ * @par Example
+ * @verbatim
+   if (!lz4Decompress(packed.data(), packed.size(), plane, size))
+   {
+       cout << "File is damaged";
+   }
+   @endverbatim
+ *****************************************************************************/
+bool lz4Decompress(const pixel* src, size_t length, pixel* dst, size_t size)
+{
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < length)
+    {
+        int token = src[ip++];
+        size_t count = size_t(token >> 4);
+        size_t matchLength;
+        size_t offset;
+        size_t i;
+
+        if (count == 15)
+        {
+            int more;
+
+            do
+            {
+                if (ip >= length)
+                {
+                    return false;
+                }
+
+                more = src[ip++];
+                count += size_t(more);
+            } while (more == 255);
+        }
+
+        if (count > length - ip || count > size - op)
+        {
+            return false;
+        }
+
+        memcpy(dst + op, src + ip, count);
+        ip += count;
+        op += count;
+
+        //THE LAST SEQUENCE HAS NO MATCH
+        if (ip == length)
+        {
+            break;
+        }
+
+        if (length - ip < 2)
+        {
+            return false;
+        }
+
+        offset = size_t(src[ip]) | (size_t(src[ip + 1]) << 8);
+        ip += 2;
+
+        if (offset == 0 || offset > op)
+        {
+            return false;
+        }
+
+        matchLength = size_t(token & 15);
+
+        if (matchLength == 15)
+        {
+            int more;
+
+            do
+            {
+                if (ip >= length)
+                {
+                    return false;
+                }
+
+                more = src[ip++];
+                matchLength += size_t(more);
+            } while (more == 255);
+        }
+
+        matchLength += 4;
+
+        if (matchLength > size - op)
+        {
+            return false;
+        }
+
+        //MATCHES MAY OVERLAP THEIR OWN OUTPUT, SO COPY BYTE BY BYTE
+        for (i = 0; i < matchLength; i++)
+        {
+            dst[op + i] = dst[op + i - offset];
+        }
+
+        op += matchLength;
+    }
+
+    return op == size;
+}
+
+//WRITE PLANAR IMAGE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function writes an image in the program's own planar format, meant
+ * for handing images from one run of the program to the next. The planes are
+ * stored one after the other, just as they are held in memory, so neither
+ * writing nor reading has to interleave or parse anything.
+ *
+ * The file starts with the magic number and a newline, then the columns,
+ * rows and comment length as 4 byte little endian values, then the comment,
+ * cut to MAX_COMMENT_LENGTH bytes.
+ * TP3 and TZ3 images hold red, green and blue planes, TP1 and TZ1 images
+ * only the gray plane. TP planes are raw, TZ planes are each preceded by
+ * their compressed size and hold every row delta filtered, meaning each
+ * pixel is stored as its difference from the one on its left, and then LZ4
+ * compressed. Smooth areas turn into runs of small values that compress
+ * well, and the planes are compressed on separate threads.
+ *
+ * @param[in, out]  out - stream to write the image to.
+ * @param[in]       img - defined image structure to obtain data from.
+ *
+ * @par Example
+ * @verbatim
+   img.magicNumber = "TZ3";
+   writePlanar(out, img);
+   @endverbatim
+ *****************************************************************************/
+void writePlanar(ostream& out, image& img)
+{
+    int p, i;
+    int planes = img.magicNumber[2] == '1' ? 1 : 3;
+    pixel** data[3] = { img.redGray, img.green, img.blue };
+
+    out << img.magicNumber << '\n';
+    put32(out, (unsigned long long)img.cols);
+    put32(out, (unsigned long long)img.rows);
+    string comment = img.comment.substr(0, MAX_COMMENT_LENGTH);
+    put32(out, comment.size());
+    out << comment;
+
+    if (img.magicNumber[1] == 'P')
+    {
+        for (p = 0; p < planes; p++)
+        {
+            for (i = 0; i < img.rows; i++)
+            {
+                out.write((char*)data[p][i], img.cols);
+            }
+        }
+
+        return;
+    }
+
+    size_t size = size_t(img.rows) * img.cols;
+    vector<vector<pixel>> packed(planes);
+
+    parallelBands(planes, [&](int, int first, int last)
+    {
+        int plane, r, c;
+        vector<pixel> filtered(size);
+
+        trackMemory((long long)size);
+
+        for (plane = first; plane < last; plane++)
+        {
+            for (r = 0; r < img.rows; r++)
+            {
+                pixel* row = data[plane][r];
+                pixel* f = filtered.data() + size_t(r) * img.cols;
+                pixel left = 0;
+
+                for (c = 0; c < img.cols; c++)
+                {
+                    f[c] = pixel(row[c] - left);
+                    left = row[c];
+                }
+            }
+
+            packed[plane].resize(lz4Bound(size));
+            trackMemory((long long)lz4Bound(size));
+            packed[plane].resize(lz4Compress(filtered.data(), size, packed[plane].data()));
+        }
+
+        trackMemory(-(long long)size);
+    });
+
+    for (p = 0; p < planes; p++)
+    {
+        put32(out, packed[p].size());
+        out.write((char*)packed[p].data(), packed[p].size());
+    }
+
+    trackMemory(-(long long)lz4Bound(size) * planes);
+}
+
+//READ PLANAR HEADER
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads the magic number, size and comment at the start of a
+ * planar image, leaving the stream at the first plane.
+ *
+ * @param[in, out]  fin - stream positioned at the magic number.
+ * @param[in, out]  img - defined image structure to store the header in.
+ *
+ * @return true if the header is valid.
+ *
+ * @par Example
+ * @verbatim
+   if (readPlanarHeader(fin, img))
+   {
+       cout << img.cols << " by " << img.rows;
+   }
+   @endverbatim
+ *****************************************************************************/
+bool readPlanarHeader(istream& fin, image& img)
+{
+    unsigned long long cols, rows, length;
+    char magic[4];
+
+    if (!fin.read(magic, 4) || magic[0] != 'T' || (magic[1] != 'P' && magic[1] != 'Z') ||
+        (magic[2] != '1' && magic[2] != '3') || magic[3] != '\n')
+    {
+        return false;
+    }
+
+    if (!get32(fin, cols) || !get32(fin, rows) || !get32(fin, length))
+    {
+        return false;
+    }
+
+    //THE SIZE IS CHECKED BEFORE IT IS NARROWED TO INT OR MULTIPLIED
+    if (cols == 0 || rows == 0 || cols > INT_MAX || rows > INT_MAX ||
+        rows > (unsigned long long)MAX_IMAGE_PIXELS / cols)
+    {
+        return false;
+    }
+
+    if (length > MAX_COMMENT_LENGTH)
+    {
+        return false;
+    }
+
+    img.magicNumber = string(magic, 3);
+    img.comment.assign(size_t(length), ' ');
+
+    if (length > 0 && !fin.read(&img.comment[0], length))
+    {
+        return false;
+    }
+
+    img.rows = int(rows);
+    img.cols = int(cols);
+
+    return true;
+}
+
+//READ PLANAR IMAGE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads an image written by writePlanar. Raw planes are read
+ * straight into the rows of the image. Compressed planes are read first and
+ * then expanded and un-filtered on separate threads. A gray image has its
+ * plane copied into green and blue, so it can be edited like any other.
+ *
+ * @param[in, out]  fin - stream positioned at the magic number.
+ * @param[in, out]  img - defined image structure to store data in.
+ *
+ * @return true if the image was read, false if it is not valid.
+ *
+ * @par Example
+ * @verbatim
+   if (fin.rdbuf()->sgetc() == 'T' && readPlanar(fin, img))
+   {
+       cout << "Read a " << img.cols << " by " << img.rows << " image";
+   }
+   @endverbatim
+ *****************************************************************************/
+bool readPlanar(istream& fin, image& img)
+{
+    int p, i;
+    int oldRows = img.rows;
+    int oldCols = img.cols;
+    unsigned long long length;
+
+    if (!readPlanarHeader(fin, img))
+    {
+        return false;
+    }
+
+    int planes = img.magicNumber[2] - '0';
+
+    resizeimage(img, oldRows, oldCols);
+
+    pixel** data[3] = { img.redGray, img.green, img.blue };
+
+    if (img.magicNumber[1] == 'P')
+    {
+        for (p = 0; p < planes; p++)
+        {
+            for (i = 0; i < img.rows; i++)
+            {
+                if (!fin.read((char*)data[p][i], img.cols))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    else
+    {
+        size_t size = size_t(img.rows) * img.cols;
+        vector<vector<pixel>> packed(planes);
+        vector<char> valid(planes, 1);
+        long long held = 0;
+        bool complete = true;
+
+        for (p = 0; p < planes && complete; p++)
+        {
+            if (!get32(fin, length) || length > lz4Bound(size))
+            {
+                complete = false;
+                break;
+            }
+
+            packed[p].resize(size_t(length));
+            held += (long long)length;
+            trackMemory((long long)length);
+
+            if (!fin.read((char*)packed[p].data(), length))
+            {
+                complete = false;
+            }
+        }
+
+        parallelBands(complete ? planes : 0, [&](int, int first, int last)
+        {
+            int plane, r, c;
+            vector<pixel> filtered(size);
+
+            trackMemory((long long)size);
+
+            for (plane = first; plane < last; plane++)
+            {
+                if (!lz4Decompress(packed[plane].data(), packed[plane].size(), filtered.data(), size))
+                {
+                    valid[plane] = 0;
+                    continue;
+                }
+
+                for (r = 0; r < img.rows; r++)
+                {
+                    pixel* row = data[plane][r];
+                    pixel* f = filtered.data() + size_t(r) * img.cols;
+                    pixel left = 0;
+
+                    for (c = 0; c < img.cols; c++)
+                    {
+                        left = pixel(left + f[c]);
+                        row[c] = left;
+                    }
+                }
+            }
+
+            trackMemory(-(long long)size);
+        });
+
+        trackMemory(-held);
+
+        if (!complete || find(valid.begin(), valid.end(), 0) != valid.end())
+        {
+            return false;
+        }
+    }
+
+    if (planes == 1)
+    {
+        for (i = 0; i < img.rows; i++)
+        {
+            memcpy(img.green[i], img.redGray[i], img.cols);
+            memcpy(img.blue[i], img.redGray[i], img.cols);
+        }
+    }
+
+    return true;
+}
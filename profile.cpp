@@ -0,0 +1,477 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Number of counters kept for every stage, and the position of each in the
+* counts of a stage: cycles, instructions, last level cache misses, data
+* TLB misses, branch misses, CPU time in nanoseconds and page faults.
+************************************************************************/
+const int PROFILE_EVENTS = 7;
+const int CYCLES = 0;
+const int INSTRUCTIONS = 1;
+const int CACHE_MISSES = 2;
+const int TLB_MISSES = 3;
+const int BRANCH_MISSES = 4;
+const int CPU_TIME = 5;
+const int PAGE_FAULTS = 6;
+
+#ifdef __linux__
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Type and configuration given to perf_event_open for every counter, in
+* the order above. The last two are software counters of the kernel, which
+* work even where the processor's counters are not available, such as in
+* most virtual machines.
+************************************************************************/
+const unsigned PROFILE_TYPES[PROFILE_EVENTS] =
+{
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+    PERF_TYPE_HARDWARE, PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE
+};
+const unsigned long long PROFILE_CONFIGS[PROFILE_EVENTS] =
+{
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_PAGE_FAULTS
+};
+#endif
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Totals of one stage of a job, such as decode or encode, over every time
+* the stage ran: its wall clock time, the bytes of image it worked on and
+* its counters summed over all threads.
+************************************************************************/
+struct stageProfile
+{
+    string name;
+    double seconds = 0;
+    long long bytes = 0;
+    long long counts[PROFILE_EVENTS] = {};
+};
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* State of the profile: the counters of every thread, PROFILE_EVENTS to a
+* thread with -1 for those that could not be opened, which counters opened
+* on any thread, the stages in the order they first ran, and the stage
+* running now with the time and counts it started at.
+************************************************************************/
+struct profileState
+{
+    mutex lock;
+    vector<int> counters;
+    bool available[PROFILE_EVENTS] = {};
+    vector<stageProfile> stages;
+    int current = -1;
+    chrono::steady_clock::time_point started;
+    long long startCounts[PROFILE_EVENTS] = {};
+};
+
+//PROFILE STATE
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* The profile is never freed, as the detached workers may still hold
+* counters when the program ends.
+************************************************************************/
+static profileState* profile = new profileState;
+
+//READ THE COUNTERS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function sums every counter over all the threads counted so far.
+ * The counters of threads that have ended keep their last value. A counter
+ * the kernel could only run part of the time, as it shares the processor's
+ * few counters with others, is scaled up to the whole time.
+ *
+ * @param[out]  counts - sum of every counter.
+ *
+ * @par Example
+ * @verbatim
+   long long now[PROFILE_EVENTS];
+   readCounters(now);
+   @endverbatim
+ *****************************************************************************/
+static void readCounters(long long counts[PROFILE_EVENTS])
+{
+    int k;
+
+    for (k = 0; k < PROFILE_EVENTS; k++)
+    {
+        counts[k] = 0;
+    }
+
+#ifdef __linux__
+    for (size_t i = 0; i < profile->counters.size(); i++)
+    {
+        unsigned long long value[3];
+        int fd = profile->counters[i];
+
+        if (fd < 0 || read(fd, value, sizeof(value)) != sizeof(value) || value[2] == 0)
+        {
+            continue;
+        }
+
+        counts[i % PROFILE_EVENTS] += (long long)((double)value[0] * value[1] / value[2]);
+    }
+#endif
+}
+
+//COUNT THIS THREAD
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function starts the counters of the calling thread when --profile
+ * is given, and does nothing otherwise. The kernel counts a thread only
+ * once asked to, so every thread that works on a job calls this when it
+ * starts: the main thread, the workers and the reading and writing
+ * threads of the files. Only user mode is counted, which the kernel allows
+ * without special rights on most systems. Counters that cannot be opened
+ * are left out of the profile.
+ *
+ * @par Example
+ * @verbatim
+   void workLoop(int index)
+   {
+       profileThread();
+       //take and run tasks
+   }
+   @endverbatim
+ *****************************************************************************/
+void profileThread()
+{
+    if (!config.profile)
+    {
+        return;
+    }
+
+#ifdef __linux__
+    int fds[PROFILE_EVENTS];
+    int k;
+
+    for (k = 0; k < PROFILE_EVENTS; k++)
+    {
+        perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PROFILE_TYPES[k];
+        attr.config = PROFILE_CONFIGS[k];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        fds[k] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    lock_guard<mutex> guard(profile->lock);
+
+    for (k = 0; k < PROFILE_EVENTS; k++)
+    {
+        profile->counters.push_back(fds[k]);
+
+        if (fds[k] >= 0)
+        {
+            profile->available[k] = true;
+        }
+    }
+#endif
+}
+
+//END THE CURRENT STAGE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function adds the time and counts since the current stage started
+ * to its totals, and leaves no stage running. It does nothing when
+ * --profile is not given.
+ *
+ * @par Example
+ * @verbatim
+   beginStage("flush output");
+   fout.close();
+   endStage();
+   @endverbatim
+ *****************************************************************************/
+void endStage()
+{
+    if (!config.profile)
+    {
+        return;
+    }
+
+    lock_guard<mutex> guard(profile->lock);
+
+    if (profile->current < 0)
+    {
+        return;
+    }
+
+    stageProfile& stage = profile->stages[profile->current];
+    long long now[PROFILE_EVENTS];
+
+    readCounters(now);
+
+    for (int k = 0; k < PROFILE_EVENTS; k++)
+    {
+        stage.counts[k] += now[k] - profile->startCounts[k];
+    }
+
+    stage.seconds += chrono::duration<double>(chrono::steady_clock::now() -
+        profile->started).count();
+
+    profile->current = -1;
+}
+
+//BEGIN A STAGE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function ends the current stage and starts the named one. A stage
+ * that runs again, as for every frame of a stream, adds to the totals it
+ * already has. Everything every counted thread does until the next stage
+ * begins is put down to this stage, including the reading and writing
+ * threads working ahead. It does nothing when --profile is not given.
+ *
+ * @param[in]  name - name of the stage, such as decode or --sepia.
+ *
+ * @par Example
+ * @verbatim
+   beginStage("encode");
+   writeImageData(out, img);
+   @endverbatim
+ *****************************************************************************/
+void beginStage(string name)
+{
+    if (!config.profile)
+    {
+        return;
+    }
+
+    endStage();
+
+    lock_guard<mutex> guard(profile->lock);
+    size_t i;
+
+    for (i = 0; i < profile->stages.size() && profile->stages[i].name != name; i++)
+    {
+    }
+
+    if (i == profile->stages.size())
+    {
+        profile->stages.push_back(stageProfile());
+        profile->stages[i].name = name;
+    }
+
+    profile->current = int(i);
+    profile->started = chrono::steady_clock::now();
+    readCounters(profile->startCounts);
+}
+
+//MOVE ON FROM A STAGE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function begins the stage to, but only if the current stage is
+ * from. readImage uses it to split the header from the decode when it
+ * reads the input of the job, and not when an operation reads another
+ * image, such as an overlay.
+ *
+ * @param[in]  from - stage that must be running.
+ * @param[in]  to - stage to begin.
+ *
+ * @par Example
+ * @verbatim
+   nextStage("header", "decode");
+   @endverbatim
+ *****************************************************************************/
+void nextStage(string from, string to)
+{
+    if (!config.profile)
+    {
+        return;
+    }
+
+    {
+        lock_guard<mutex> guard(profile->lock);
+
+        if (profile->current < 0 || profile->stages[profile->current].name != from)
+        {
+            return;
+        }
+    }
+
+    beginStage(to);
+}
+
+//BYTES OF A STAGE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function adds the bytes of the planes of an image to the bytes the
+ * current stage has worked on, from which its bytes per cycle and MB/s are
+ * worked out.
+ *
+ * @param[in]  img - image the stage has worked on.
+ *
+ * @par Example
+ * @verbatim
+   beginStage("--sepia");
+   applyOption("--sepia", img, "--binary", nullptr);
+   stageBytes(img);
+   @endverbatim
+ *****************************************************************************/
+void stageBytes(image& img)
+{
+    long long bytes = (long long)img.rows * img.cols * (img.alpha != nullptr ? 4 : 3);
+
+    if (!config.profile)
+    {
+        return;
+    }
+
+    lock_guard<mutex> guard(profile->lock);
+
+    if (profile->current >= 0)
+    {
+        profile->stages[profile->current].bytes += bytes;
+    }
+}
+
+//PRINT PROFILE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function ends the current stage and prints a line for every stage:
+ * its wall clock and CPU time, instructions per cycle, bytes of image per
+ * cycle and the cache, TLB and branch misses. A counter that could not be
+ * opened is shown as -, and when the processor's counters are missing
+ * altogether a note says so, leaving the times, the bytes per second and
+ * the page faults of the kernel's own counters.
+ *
+ * @param[in, out]  log - stream to print the profile to.
+ *
+ * @par Example
+ * @verbatim
+   printProfile(cout);
+   //Stage             Wall ms    CPU ms    IPC  Bytes/cyc  MB/s ...
+   //decode               41.2     160.3   2.41     0.35   1650.8 ...
+   @endverbatim
+ *****************************************************************************/
+void printProfile(ostream& log)
+{
+    if (!config.profile)
+    {
+        return;
+    }
+
+    endStage();
+
+    lock_guard<mutex> guard(profile->lock);
+    bool* available = profile->available;
+
+    //PRINTS A COUNT, OR - IF ITS COUNTER COULD NOT BE OPENED
+    auto count = [&](const stageProfile& stage, int k)
+    {
+        if (available[k])
+        {
+            log << setw(13) << stage.counts[k];
+        }
+        else
+        {
+            log << setw(13) << "-";
+        }
+    };
+
+    if (!available[CYCLES] || !available[INSTRUCTIONS])
+    {
+        log << "Hardware counters are not available, so only times, MB/s and the"
+            << " counters of the kernel are shown" << endl;
+    }
+
+    log << left << setw(16) << "Stage" << right << setw(10) << "Wall ms" << setw(10)
+        << "CPU ms" << setw(7) << "IPC" << setw(11) << "Bytes/cyc" << setw(10) << "MB/s"
+        << setw(13) << "Cache miss" << setw(13) << "TLB miss" << setw(13) << "Branch miss"
+        << setw(13) << "Page faults" << endl;
+
+    log << fixed << setprecision(2);
+
+    for (const stageProfile& stage : profile->stages)
+    {
+        double cycles = double(stage.counts[CYCLES]);
+
+        log << left << setw(16) << stage.name << right << setw(10) << stage.seconds * 1000;
+
+        if (available[CPU_TIME])
+        {
+            log << setw(10) << stage.counts[CPU_TIME] / 1e6;
+        }
+        else
+        {
+            log << setw(10) << "-";
+        }
+
+        if (available[CYCLES] && available[INSTRUCTIONS] && cycles > 0)
+        {
+            log << setw(7) << stage.counts[INSTRUCTIONS] / cycles;
+        }
+        else
+        {
+            log << setw(7) << "-";
+        }
+
+        if (available[CYCLES] && cycles > 0 && stage.bytes > 0)
+        {
+            log << setw(11) << stage.bytes / cycles;
+        }
+        else
+        {
+            log << setw(11) << "-";
+        }
+
+        if (stage.seconds > 0 && stage.bytes > 0)
+        {
+            log << setw(10) << stage.bytes / stage.seconds / 1e6;
+        }
+        else
+        {
+            log << setw(10) << "-";
+        }
+
+        count(stage, CACHE_MISSES);
+        count(stage, TLB_MISSES);
+        count(stage, BRANCH_MISSES);
+        count(stage, PAGE_FAULTS);
+        log << endl;
+    }
+
+    log.unsetf(ios::fixed);
+}
@@ -0,0 +1,133 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+//HALVE A ROW
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function makes one row of the next smaller pyramid level from two
+ * rows of a plane, each pixel the rounded mean of a 2 by 2 box. When the
+ * width is odd, the last pixel is the mean of the last column alone.
+ *
+ * @param[in]   top - upper row of the box.
+ * @param[in]   bottom - lower row of the box, the same as top on the last
+ *                       row of a plane with an odd height.
+ * @param[out]  dst - row to write, (count + 1) / 2 pixels.
+ * @param[in]   count - number of pixels in the source rows.
+ *
+ * @par Example
+ * @verbatim
+   halveRow(img.green[2 * i], img.green[2 * i + 1], half.green[i], img.cols);
+   @endverbatim
+ *****************************************************************************/
+static void halveRow(const pixel* top, const pixel* bottom, pixel* dst, int count)
+{
+    int j;
+
+    for (j = 0; j < count / 2; j++)
+    {
+        dst[j] = pixel((top[2 * j] + top[2 * j + 1] + bottom[2 * j] +
+            bottom[2 * j + 1] + 2) >> 2);
+    }
+
+    if (count % 2 == 1)
+    {
+        dst[j] = pixel((top[2 * j] + bottom[2 * j] + 1) >> 1);
+    }
+}
+
+//PYRAMID
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function writes the number of levels given with --pyramid, each half
+ * the width and height of the one before, as basename_1, basename_2 and so
+ * on. All levels are made from the one decoded image. The rows of the last
+ * level are split into bands for the threads, and each band is worked in
+ * short strips: a strip makes its rows of level 1, then the rows of level 2
+ * from those while they are still in the cache, and so on down to the last
+ * level. The image itself is left as it is.
+ *
+ * @param[in]  img - defined image structure to make the levels from.
+ * @param[in]  type - contains type of output file needed.
+ * @param[in]  basename - base name of the output files.
+ *
+ * @par Example
+ * @verbatim
+   config.pyramidLevels = 3;
+   pyramid(img, "--binary", "small");
+   //writes small_1.ppm, small_2.ppm and small_3.ppm
+   @endverbatim
+ *****************************************************************************/
+void pyramid(image& img, string type, string basename)
+{
+    int levels = config.pyramidLevels;
+    vector<image> level(levels + 1);
+    ofstream fout;
+
+    level[0] = img;
+
+    for (int k = 1; k <= levels; k++)
+    {
+        level[k].rows = (level[k - 1].rows + 1) / 2;
+        level[k].cols = (level[k - 1].cols + 1) / 2;
+        level[k].comment = img.comment;
+
+        allocarray(level[k].redGray, level[k].rows, level[k].cols);
+        allocarray(level[k].green, level[k].rows, level[k].cols);
+        allocarray(level[k].blue, level[k].rows, level[k].cols);
+
+        if (img.alpha != nullptr)
+        {
+            allocarray(level[k].alpha, level[k].rows, level[k].cols);
+        }
+
+        setOutputType(level[k], type, false);
+    }
+
+    //A STRIP OF LEVEL 1 SHOULD FIT IN THE CACHE OF ONE CORE
+    long long stripBytes = (long long)level[1].cols * (img.alpha != nullptr ? 4 : 3) <<
+        (levels - 1);
+    int step = int(max(1LL, (256LL << 10) / stripBytes));
+
+    parallelBands(level[levels].rows, [&](int, int first, int last)
+    {
+        for (int start = first; start < last; start += step)
+        {
+            int stop = min(start + step, last);
+
+            for (int k = 1; k <= levels; k++)
+            {
+                image& from = level[k - 1];
+                image& to = level[k];
+                int shift = levels - k;
+                int begin = int(min((long long)start << shift, (long long)to.rows));
+                int end = int(min((long long)stop << shift, (long long)to.rows));
+
+                for (int i = begin; i < end; i++)
+                {
+                    int upper = 2 * i;
+                    int lower = min(2 * i + 1, from.rows - 1);
+
+                    halveRow(from.redGray[upper], from.redGray[lower], to.redGray[i], from.cols);
+                    halveRow(from.green[upper], from.green[lower], to.green[i], from.cols);
+                    halveRow(from.blue[upper], from.blue[lower], to.blue[i], from.cols);
+
+                    if (to.alpha != nullptr)
+                    {
+                        halveRow(from.alpha[upper], from.alpha[lower], to.alpha[i], from.cols);
+                    }
+                }
+            }
+        }
+    });
+
+    for (int k = 1; k <= levels; k++)
+    {
+        writeImage(fout, level[k], basename + "_" + to_string(k));
+    }
+}
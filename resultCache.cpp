@@ -0,0 +1,660 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Prime constants of the xxHash64 algorithm.
+************************************************************************/
+const unsigned long long PRIME1 = 11400714785074694791ULL;
+const unsigned long long PRIME2 = 14029467366897019727ULL;
+const unsigned long long PRIME3 = 1609587929392839161ULL;
+const unsigned long long PRIME4 = 9650029242287828579ULL;
+const unsigned long long PRIME5 = 2870177450012600261ULL;
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Version of the cache layout, part of every key so that a change in the
+* way results are produced never serves an old result.
+************************************************************************/
+const char* CACHE_VERSION = "thpe11-cache-1";
+
+//ROTATE LEFT
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function rotates the bits of a 64 bit value to the left.
+ *
+ * @param[in]  value - value to rotate.
+ * @param[in]  bits - number of bits to rotate by, 1 to 63.
+ *
+ * @return the rotated value.
+ *
+ * @par Example
+ * @verbatim
+   rotl64(1, 63); //0x8000000000000000
+   @endverbatim
+ *****************************************************************************/
+static unsigned long long rotl64(unsigned long long value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+//READ 8 BYTES
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads 8 bytes as a little endian 64 bit value, whatever the
+ * alignment of the data and the byte order of the machine.
+ *
+ * @param[in]  data - first of the 8 bytes.
+ *
+ * @return the value of the bytes.
+ *
+ * @par Example
+ * @verbatim
+   unsigned long long v = read64(buffer + 8);
+   @endverbatim
+ *****************************************************************************/
+static unsigned long long read64(const unsigned char* data)
+{
+    unsigned long long value = 0;
+    int i;
+
+    for (i = 7; i >= 0; i--)
+    {
+        value = (value << 8) | data[i];
+    }
+
+    return value;
+}
+
+//READ 4 BYTES
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads 4 bytes as a little endian 32 bit value.
+ *
+ * @param[in]  data - first of the 4 bytes.
+ *
+ * @return the value of the bytes.
+ *
+ * @par Example
+ * @verbatim
+   unsigned long long v = read32(buffer + 4);
+   @endverbatim
+ *****************************************************************************/
+static unsigned long long read32(const unsigned char* data)
+{
+    return (unsigned long long)data[0] | ((unsigned long long)data[1] << 8) |
+        ((unsigned long long)data[2] << 16) | ((unsigned long long)data[3] << 24);
+}
+
+//XXHASH64 ROUND
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function mixes one 8 byte lane of input into an xxHash64 accumulator.
+ *
+ * @param[in]  acc - accumulator.
+ * @param[in]  lane - 8 bytes of input.
+ *
+ * @return the new accumulator.
+ *
+ * @par Example
+ * @verbatim
+   v1 = hashRound(v1, read64(p));
+   @endverbatim
+ *****************************************************************************/
+static unsigned long long hashRound(unsigned long long acc, unsigned long long lane)
+{
+    acc = acc + lane * PRIME2;
+    acc = rotl64(acc, 31);
+
+    return acc * PRIME1;
+}
+
+//XXHASH64 MERGE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function folds one of the four xxHash64 accumulators into the hash.
+ *
+ * @param[in]  hash - hash so far.
+ * @param[in]  acc - accumulator to fold in.
+ *
+ * @return the new hash.
+ *
+ * @par Example
+ * @verbatim
+   hash = hashMerge(hash, v1);
+   @endverbatim
+ *****************************************************************************/
+static unsigned long long hashMerge(unsigned long long hash, unsigned long long acc)
+{
+    hash = hash ^ hashRound(0, acc);
+
+    return hash * PRIME1 + PRIME4;
+}
+
+//HASH BYTES
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function computes the xxHash64 of a block of bytes. It handles 32
+ * bytes per step and is limited by memory speed rather than by the hashing.
+ *
+ * @param[in]  data - bytes to hash.
+ * @param[in]  length - number of bytes.
+ * @param[in]  seed - starting value, such as the hash of the bytes before.
+ *
+ * @return the 64 bit hash.
+ *
+ * @par Example
+ * @verbatim
+   unsigned long long h = hashBytes("abc", 3, 0); //0x44bc2cf5ad770999
+   @endverbatim
+ *****************************************************************************/
+unsigned long long hashBytes(const char* data, size_t length, unsigned long long seed)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + length;
+    unsigned long long hash;
+
+    if (length >= 32)
+    {
+        unsigned long long v1 = seed + PRIME1 + PRIME2;
+        unsigned long long v2 = seed + PRIME2;
+        unsigned long long v3 = seed;
+        unsigned long long v4 = seed - PRIME1;
+
+        while (p + 32 <= end)
+        {
+            v1 = hashRound(v1, read64(p));
+            v2 = hashRound(v2, read64(p + 8));
+            v3 = hashRound(v3, read64(p + 16));
+            v4 = hashRound(v4, read64(p + 24));
+            p += 32;
+        }
+
+        hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        hash = hashMerge(hash, v1);
+        hash = hashMerge(hash, v2);
+        hash = hashMerge(hash, v3);
+        hash = hashMerge(hash, v4);
+    }
+    else
+    {
+        hash = seed + PRIME5;
+    }
+
+    hash = hash + length;
+
+    while (p + 8 <= end)
+    {
+        hash = hash ^ hashRound(0, read64(p));
+        hash = rotl64(hash, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+
+    if (p + 4 <= end)
+    {
+        hash = hash ^ (read32(p) * PRIME1);
+        hash = rotl64(hash, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+
+    while (p < end)
+    {
+        hash = hash ^ (*p * PRIME5);
+        hash = rotl64(hash, 11) * PRIME1;
+        p++;
+    }
+
+    hash = hash ^ (hash >> 33);
+    hash = hash * PRIME2;
+    hash = hash ^ (hash >> 29);
+    hash = hash * PRIME3;
+    hash = hash ^ (hash >> 32);
+
+    return hash;
+}
+
+//HASH A FILE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function hashes the bytes of a file one chunk at a time, each chunk
+ * seeded with the hash of the ones before it.
+ *
+ * @param[in]   filename - name of the file.
+ * @param[out]  hash - hash of the whole file.
+ *
+ * @return true if the file could be read.
+ *
+ * @par Example
+ * @verbatim
+   unsigned long long hash;
+   hashFile("BalloonsA.ppm", hash);
+   @endverbatim
+ *****************************************************************************/
+static bool hashFile(string filename, unsigned long long& hash)
+{
+    ifstream fin(filename, ios::binary);
+    vector<char> buffer(IO_CHUNK_SIZE);
+
+    hash = 0;
+
+    if (!fin.is_open())
+    {
+        return false;
+    }
+
+    while (fin)
+    {
+        fin.read(buffer.data(), buffer.size());
+        hash = hashBytes(buffer.data(), size_t(fin.gcount()), hash);
+    }
+
+    return true;
+}
+
+//CACHE KEY
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function builds the cache key of a job from the bytes of its input
+ * file and a canonical form of what is done to them: the cache version, the
+ * option code and the output type. Hashing the file rather than the decoded
+ * pixels means a hit never needs a decode.
+ *
+ * @param[in]  input - name of the input file.
+ * @param[in]  option - option code given on the command line.
+ * @param[in]  type - contains type of output file needed.
+ *
+ * @return the key as 16 hexadecimal digits, or an empty string if the input
+ *         cannot be read.
+ *
+ * @par Example
+ * @verbatim
+   string key = cacheKey("BalloonsA.ppm", "--sepia", "--binary");
+   @endverbatim
+ *****************************************************************************/
+string cacheKey(string input, string option, string type)
+{
+    unsigned long long hash;
+    string job;
+    char hex[17];
+
+    if (!hashFile(input, hash))
+    {
+        return "";
+    }
+
+    job = string(CACHE_VERSION) + '\n' + option + '\n' + type;
+    hash = hashBytes(job.data(), job.size(), hash);
+
+    snprintf(hex, sizeof(hex), "%016llx", hash);
+
+    return hex;
+}
+
+//SHARE OR COPY A FILE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function makes the file to hold the same bytes as the file from, as
+ * cheaply as the file system allows. A reflink shares the data until either
+ * file changes, which Linux offers on btrfs and xfs. A hard link shares the
+ * file itself. If neither works the bytes are copied. An existing file to is
+ * replaced.
+ *
+ * @param[in]  from - file to take the bytes from.
+ * @param[in]  to - file to create.
+ *
+ * @return true if the file was created.
+ *
+ * @par Example
+ * @verbatim
+   linkOrCopy("cache/0123456789abcdef.ppm", "sepia.ppm");
+   @endverbatim
+ *****************************************************************************/
+bool linkOrCopy(string from, string to)
+{
+    error_code failed;
+
+    fs::remove(to, failed);
+
+#ifdef __linux__
+    int source = open(from.c_str(), O_RDONLY);
+
+    if (source >= 0)
+    {
+        int target = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool cloned = target >= 0 && ioctl(target, FICLONE, source) == 0;
+
+        if (target >= 0)
+        {
+            close(target);
+        }
+        close(source);
+
+        if (cloned)
+        {
+            return true;
+        }
+
+        fs::remove(to, failed);
+    }
+#endif
+
+    fs::create_hard_link(from, to, failed);
+
+    if (!failed)
+    {
+        return true;
+    }
+
+    return fs::copy_file(from, to, fs::copy_options::overwrite_existing, failed);
+}
+
+//CHECKSUM FILE OF A RESULT
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function returns the name of the file holding the checksum of a
+ * stored result: the result's name with the extension .sum.
+ *
+ * @param[in]  entry - path of the stored result.
+ *
+ * @return path of its checksum file.
+ *
+ * @par Example
+ * @verbatim
+   fs::path sum = checksumFile("cache/0123456789abcdef.ppm");
+   //cache/0123456789abcdef.sum
+   @endverbatim
+ *****************************************************************************/
+static fs::path checksumFile(fs::path entry)
+{
+    return entry.replace_extension(".sum");
+}
+
+//CHECK A RESULT
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function checks that a stored result still holds the bytes it was
+ * stored with, by hashing it again and comparing with its checksum file.
+ * Results are shared with outputs by links where the file system allows,
+ * so a later edit of an output in place would otherwise change the result
+ * too. A result that fails the check, or has no checksum, is removed.
+ *
+ * @param[in]  entry - path of the stored result.
+ *
+ * @return true if the result is intact.
+ *
+ * @par Example
+ * @verbatim
+   if (!checkResult(entry))
+   {
+       //treat as a miss, the job is done again
+   }
+   @endverbatim
+ *****************************************************************************/
+static bool checkResult(fs::path entry)
+{
+    error_code failed;
+    ifstream fin(checksumFile(entry));
+    unsigned long long stored = 0;
+    unsigned long long hash;
+
+    if (fin >> hex >> stored && hashFile(entry.string(), hash) && hash == stored)
+    {
+        return true;
+    }
+
+    fin.close();
+    fs::remove(entry, failed);
+    fs::remove(checksumFile(entry), failed);
+
+    return false;
+}
+
+//FIND CACHED RESULT
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function looks for the result stored under a key. Results keep the
+ * extension of the output they were made from, so every extension the
+ * program can write is tried.
+ *
+ * @param[in]  dir - cache directory.
+ * @param[in]  key - key built by cacheKey.
+ *
+ * @return path of the stored result, or an empty string if there is none.
+ *
+ * @par Example
+ * @verbatim
+   string entry = cacheFind("cache", key); //"cache/0123456789abcdef.ppm"
+   @endverbatim
+ *****************************************************************************/
+string cacheFind(string dir, string key)
+{
+    int i;
+    error_code failed;
+
+    for (i = 0; OUTPUT_EXTENSIONS[i] != nullptr; i++)
+    {
+        fs::path entry = fs::path(dir) / (key + OUTPUT_EXTENSIONS[i]);
+
+        if (fs::is_regular_file(entry, failed))
+        {
+            return entry.string();
+        }
+    }
+
+    return "";
+}
+
+//SERVE CACHED RESULT
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function writes the stored result of a job to the output, if there is
+ * one, without reading the input image at all. The result is first checked
+ * against its checksum, and a damaged one is removed and counts as a miss.
+ * The output takes the stored result's extension, or it is streamed out
+ * when the output is "-". The result is marked as just used so eviction
+ * keeps it.
+ *
+ * @param[in]  dir - cache directory.
+ * @param[in]  key - key built by cacheKey.
+ * @param[in]  output - base name of the output file, or "-".
+ *
+ * @return true if the result was served from the cache.
+ *
+ * @par Example
+ * @verbatim
+   if (!cacheLookup("cache", key, "sepia"))
+   {
+       processFrames("--sepia", "--binary", "sepia", "BalloonsA.ppm");
+   }
+   @endverbatim
+ *****************************************************************************/
+bool cacheLookup(string dir, string key, string output)
+{
+    error_code failed;
+    string entry = cacheFind(dir, key);
+
+    if (entry.empty() || !checkResult(entry))
+    {
+        return false;
+    }
+
+    if (output == "-")
+    {
+        ifstream fin;
+        ofstream fout;
+        ifstream cached(entry, ios::binary);
+
+        if (!cached.is_open())
+        {
+            return false;
+        }
+
+        ostream out(openOutput(fout, output));
+        out << cached.rdbuf();
+        out.flush();
+    }
+    else if (!linkOrCopy(entry, output + fs::path(entry).extension().string()))
+    {
+        return false;
+    }
+
+    fs::last_write_time(entry, fs::file_time_type::clock::now(), failed);
+
+    return true;
+}
+
+//STORE RESULT
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function adds a finished output file to the cache under its key,
+ * with a checksum of its bytes beside it. The result is first placed under
+ * a temporary name and then renamed, so that a run sharing the cache never
+ * sees half a result. The cache is then brought back under its size limit.
+ *
+ * @param[in]  dir - cache directory, created if missing.
+ * @param[in]  key - key built by cacheKey.
+ * @param[in]  file - output file written by the job.
+ * @param[in]  limit - largest total size of the cache in bytes.
+ *
+ * @par Example
+ * @verbatim
+   string written = processFrames("--sepia", "--binary", "sepia", "a.ppm");
+   cacheStore("cache", key, written, 1 << 30);
+   @endverbatim
+ *****************************************************************************/
+void cacheStore(string dir, string key, string file, long long limit)
+{
+    error_code failed;
+    fs::path entry = fs::path(dir) / (key + fs::path(file).extension().string());
+    fs::path partial = fs::path(dir) / (key + ".partial");
+    unsigned long long hash;
+
+    fs::create_directories(dir, failed);
+
+    if (!hashFile(file, hash))
+    {
+        return;
+    }
+
+    {
+        ofstream sum(checksumFile(entry));
+
+        sum << hex << setw(16) << setfill('0') << hash << endl;
+
+        if (!sum)
+        {
+            return;
+        }
+    }
+
+    if (!linkOrCopy(file, partial.string()))
+    {
+        fs::remove(checksumFile(entry), failed);
+        return;
+    }
+
+    fs::rename(partial, entry, failed);
+
+    if (failed)
+    {
+        fs::remove(partial, failed);
+        fs::remove(checksumFile(entry), failed);
+        return;
+    }
+
+    fs::last_write_time(entry, fs::file_time_type::clock::now(), failed);
+
+    cacheEvict(dir, limit);
+}
+
+//EVICT OLD RESULTS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function removes the least recently used results, with their
+ * checksums, until the cache holds no more than limit bytes. A result
+ * counts as used when it is stored or served, which is recorded in its
+ * modification time.
+ *
+ * @param[in]  dir - cache directory.
+ * @param[in]  limit - largest total size of the cache in bytes.
+ *
+ * @par Example
+ * @verbatim
+   cacheEvict("cache", 512LL << 20); //keep at most 512 MiB of results
+   @endverbatim
+ *****************************************************************************/
+void cacheEvict(string dir, long long limit)
+{
+    error_code failed;
+    vector<pair<fs::file_time_type, fs::path>> entries;
+    long long total = 0;
+    size_t i;
+
+    for (fs::directory_iterator it(dir, failed), end; !failed && it != end; it.increment(failed))
+    {
+        if (it->is_regular_file(failed) && it->path().extension() != ".partial" &&
+            it->path().extension() != ".sum")
+        {
+            entries.push_back(make_pair(it->last_write_time(failed), it->path()));
+            total += (long long)it->file_size(failed);
+        }
+    }
+
+    sort(entries.begin(), entries.end());
+
+    for (i = 0; i < entries.size() && total > limit; i++)
+    {
+        long long size = (long long)fs::file_size(entries[i].second, failed);
+
+        if (fs::remove(entries[i].second, failed))
+        {
+            fs::remove(checksumFile(entries[i].second), failed);
+            total -= size;
+        }
+    }
+}
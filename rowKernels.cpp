@@ -0,0 +1,480 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define ROW_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+//THE SHUFFLE KERNELS ARE BUILT FOR THEIR OWN INSTRUCTION SET, WHATEVER THE BUILD TARGETS
+#if defined(ROW_KERNELS_X86) && defined(__GNUC__)
+#define ROW_KERNEL_TARGET(name) __attribute__((target(name)))
+#else
+#define ROW_KERNEL_TARGET(name)
+#endif
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Kernel sets, from none to the widest. Each includes the ones below it.
+************************************************************************/
+const int KERNELS_SCALAR = 0;
+const int KERNELS_SSSE3 = 1;
+const int KERNELS_AVX2 = 2;
+
+//FIND THE PROCESSOR'S KERNELS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function asks the processor which instruction sets it has, so the
+ * row kernels can use them whether or not the program was built for them.
+ * AVX2 also needs the system to save the wide registers, which cpuid
+ * reports as OSXSAVE and xgetbv confirms. The answer is found once.
+ *
+ * @return the widest kernel set the processor runs, KERNELS_SCALAR on
+ *         other processors.
+ *
+ * @par Example
+ * @verbatim
+   if (rowKernels() == KERNELS_AVX2) //32 bytes a block
+   @endverbatim
+ *****************************************************************************/
+int rowKernels()
+{
+    static const int best = []
+    {
+#if defined(ROW_KERNELS_X86) && defined(_MSC_VER)
+        int info[4];
+        int highest;
+        bool ssse3, avx;
+
+        __cpuid(info, 0);
+        highest = info[0];
+        __cpuid(info, 1);
+
+        ssse3 = (info[2] & (1 << 9)) != 0;
+        avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+
+        if (avx && highest >= 7)
+        {
+            __cpuidex(info, 7, 0);
+
+            if (info[1] & (1 << 5))
+            {
+                return KERNELS_AVX2;
+            }
+        }
+
+        return ssse3 ? KERNELS_SSSE3 : KERNELS_SCALAR;
+#elif defined(ROW_KERNELS_X86)
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return KERNELS_AVX2;
+        }
+
+        return __builtin_cpu_supports("ssse3") ? KERNELS_SSSE3 : KERNELS_SCALAR;
+#else
+        return KERNELS_SCALAR;
+#endif
+    }();
+
+    return best;
+}
+
+#ifdef ROW_KERNELS_X86
+//REVERSE ROW BLOCKS WITH AVX2
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reverses 32 byte blocks taken from both ends of a row at
+ * once, moving the ends inward, until less than two blocks are left.
+ *
+ * @param[in, out]  left - start of the part of the row still to reverse.
+ * @param[in, out]  right - end of the part of the row still to reverse.
+ *
+ * @par Example
+ * @verbatim
+   reverseBlocksAVX2(left, right);
+   reverse(left, right); //the middle
+   @endverbatim
+ *****************************************************************************/
+static ROW_KERNEL_TARGET("avx2") void reverseBlocksAVX2(pixel*& left, pixel*& right)
+{
+    const __m256i mask = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4,
+        3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+    while (right - left >= 64)
+    {
+        right -= 32;
+
+        __m256i a = _mm256_loadu_si256((__m256i*)left);
+        __m256i b = _mm256_loadu_si256((__m256i*)right);
+
+        //THE SHUFFLE ONLY WORKS WITHIN 16 BYTE HALVES, SO SWAP THE HALVES TOO
+        a = _mm256_permute2x128_si256(_mm256_shuffle_epi8(a, mask), a, 0x01);
+        b = _mm256_permute2x128_si256(_mm256_shuffle_epi8(b, mask), b, 0x01);
+
+        _mm256_storeu_si256((__m256i*)left, b);
+        _mm256_storeu_si256((__m256i*)right, a);
+
+        left += 32;
+    }
+}
+
+//REVERSE ROW BLOCKS WITH SSSE3
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reverses 16 byte blocks taken from both ends of a row at
+ * once, moving the ends inward, until less than two blocks are left.
+ *
+ * @param[in, out]  left - start of the part of the row still to reverse.
+ * @param[in, out]  right - end of the part of the row still to reverse.
+ *
+ * @par Example
+ * @verbatim
+   reverseBlocksSSSE3(left, right);
+   reverse(left, right); //the middle
+   @endverbatim
+ *****************************************************************************/
+static ROW_KERNEL_TARGET("ssse3") void reverseBlocksSSSE3(pixel*& left, pixel*& right)
+{
+    const __m128i mask = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4,
+        3, 2, 1, 0);
+
+    while (right - left >= 32)
+    {
+        right -= 16;
+
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)left), mask);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)right), mask);
+
+        _mm_storeu_si128((__m128i*)left, b);
+        _mm_storeu_si128((__m128i*)right, a);
+
+        left += 16;
+    }
+}
+
+//REVERSE PACKED RGB BLOCKS WITH SSSE3
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function copies packed red, green, blue pixels 5 at a time from the
+ * end of the source to the start of the destination, while at least 6 are
+ * left. Each store writes one byte too many, which the next store or the
+ * pixels copied one at a time overwrite.
+ *
+ * @param[out]  dst - row to write, 3 * count bytes.
+ * @param[in]   src - row to read, 3 * count bytes, not overlapping dst.
+ * @param[in]   count - number of pixels in the row.
+ *
+ * @return the number of pixels copied.
+ *
+ * @par Example
+ * @verbatim
+   int j = reverseRGBSSSE3(dst, src, count); //pixels j on are still to copy
+   @endverbatim
+ *****************************************************************************/
+static ROW_KERNEL_TARGET("ssse3") int reverseRGBSSSE3(pixel* dst, const pixel* src, int count)
+{
+    int j = 0;
+
+    //BYTE 0 OF THE LOAD IS NOT PART OF THE 5 PIXELS, BYTE 15 OF THE STORE IS SPARE
+    const __m128i mask = _mm_setr_epi8(13, 14, 15, 10, 11, 12, 7, 8, 9, 4, 5, 6,
+        1, 2, 3, -128);
+
+    while (count - j >= 6)
+    {
+        const pixel* from = src + 3 * (count - j - 5) - 1;
+
+        __m128i block = _mm_loadu_si128((const __m128i*)from);
+        _mm_storeu_si128((__m128i*)(dst + 3 * j), _mm_shuffle_epi8(block, mask));
+
+        j += 5;
+    }
+
+    return j;
+}
+#endif
+
+//REVERSE A ROW WITH A KERNEL SET
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reverses a row in place with the blocks of the given
+ * kernel set, then swaps the middle of the row one pixel at a time.
+ *
+ * @param[in]       kernels - kernel set to use, no wider than rowKernels().
+ * @param[in, out]  row - row of pixels to reverse.
+ * @param[in]       count - number of pixels in the row.
+ *
+ * @par Example
+ * @verbatim
+   reverseRowWith(KERNELS_SSSE3, img.green[i], img.cols);
+   @endverbatim
+ *****************************************************************************/
+static void reverseRowWith(int kernels, pixel* row, int count)
+{
+    pixel* left = row;
+    pixel* right = row + count;
+
+#ifdef ROW_KERNELS_X86
+    if (kernels >= KERNELS_AVX2)
+    {
+        reverseBlocksAVX2(left, right);
+    }
+    else if (kernels >= KERNELS_SSSE3)
+    {
+        reverseBlocksSSSE3(left, right);
+    }
+#else
+    (void)kernels;
+#endif
+
+    reverse(left, right);
+}
+
+//REVERSE A PACKED RGB ROW WITH A KERNEL SET
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function copies a packed row with its pixels in reverse order, with
+ * the blocks of the given kernel set and then one pixel at a time.
+ *
+ * @param[in]   kernels - kernel set to use, no wider than rowKernels().
+ * @param[out]  dst - row to write, 3 * count bytes.
+ * @param[in]   src - row to read, 3 * count bytes, not overlapping dst.
+ * @param[in]   count - number of pixels in the row.
+ *
+ * @par Example
+ * @verbatim
+   reverseRowRGBWith(KERNELS_SCALAR, mirrored.data(), packed.data(), img.cols);
+   @endverbatim
+ *****************************************************************************/
+static void reverseRowRGBWith(int kernels, pixel* dst, const pixel* src, int count)
+{
+    int j = 0;
+
+#ifdef ROW_KERNELS_X86
+    if (kernels >= KERNELS_SSSE3)
+    {
+        j = reverseRGBSSSE3(dst, src, count);
+    }
+#else
+    (void)kernels;
+#endif
+
+    for (; j < count; j++)
+    {
+        const pixel* from = src + 3 * (count - j - 1);
+
+        dst[3 * j] = from[0];
+        dst[3 * j + 1] = from[1];
+        dst[3 * j + 2] = from[2];
+    }
+}
+
+//REVERSE A ROW
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reverses the order of the pixels in one row of a plane, in
+ * place. Blocks are taken from both ends of the row at once, reversed with a
+ * byte shuffle and stored at the opposite end, 32 bytes per block with AVX2
+ * and 16 with SSSE3, whichever the processor has. The middle of the row,
+ * shorter than two blocks, is swapped one pixel at a time, as is the whole
+ * row on other processors.
+ *
+ * @param[in, out]  row - row of pixels to reverse.
+ * @param[in]       count - number of pixels in the row.
+ *
+ * @par Example
+ * @verbatim
+   reverseRow(img.green[i], img.cols); //row i of green is now mirrored
+   @endverbatim
+ *****************************************************************************/
+void reverseRow(pixel* row, int count)
+{
+    reverseRowWith(rowKernels(), row, count);
+}
+
+//REVERSE A PACKED RGB ROW
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function copies a row of packed red, green, blue pixels, as stored in
+ * a binary ppm file, with the pixels in reverse order. The bytes of each
+ * pixel keep their order. When the processor has SSSE3, 5 pixels at a time
+ * are loaded from the end of the source and shuffled into place.
+ *
+ * @param[out]  dst - row to write, 3 * count bytes.
+ * @param[in]   src - row to read, 3 * count bytes, not overlapping dst.
+ * @param[in]   count - number of pixels in the row.
+ *
+ * @par Example
+ * @verbatim
+   vector<pixel> mirrored(3 * img.cols);
+   reverseRowRGB(mirrored.data(), packed.data(), img.cols);
+   @endverbatim
+ *****************************************************************************/
+void reverseRowRGB(pixel* dst, const pixel* src, int count)
+{
+    reverseRowRGBWith(rowKernels(), dst, src, count);
+}
+
+//CHECK THE ROW KERNELS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function checks the row reversal of a kernel set against a plain
+ * reversal, on rows of every length up to 300 pixels so that each block
+ * size meets every leftover middle. Packed rows are copied into a buffer
+ * filled past their end, which must be left as it was.
+ *
+ * @param[in]  kernels - kernel set to check, no wider than rowKernels().
+ *
+ * @return true if every row came out as the plain reversal, false if not.
+ *
+ * @par Example
+ * @verbatim
+   for (int kernels = 0; kernels <= rowKernels(); kernels++)
+       ok = ok && checkRowKernels(kernels);
+   @endverbatim
+ *****************************************************************************/
+bool checkRowKernels(int kernels)
+{
+    for (int count = 0; count <= 300; count++)
+    {
+        vector<pixel> row(count), expected(count);
+        vector<pixel> packed(3 * count), mirrored(3 * count + 16, 0xA5);
+
+        for (int j = 0; j < 3 * count; j++)
+        {
+            packed[j] = pixel(j * 7 + count);
+        }
+
+        for (int j = 0; j < count; j++)
+        {
+            row[j] = expected[count - j - 1] = pixel(j * 13 + count);
+        }
+
+        reverseRowWith(kernels, row.data(), count);
+        reverseRowRGBWith(kernels, mirrored.data(), packed.data(), count);
+
+        if (row != expected)
+        {
+            return false;
+        }
+
+        for (int j = 0; j < count; j++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                if (mirrored[3 * j + c] != packed[3 * (count - j - 1) + c])
+                {
+                    return false;
+                }
+            }
+        }
+
+        for (int j = 3 * count; j < 3 * count + 16; j++)
+        {
+            if (mirrored[j] != 0xA5)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+//PACK A ROW OF BITS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function packs a row of a black and white plane into the bits of a
+ * P4 bitmap, 8 pixels a byte with the leftmost in the highest bit, 1 for
+ * black and 0 for white. Pixels below 128 count as black. The bits of a
+ * partly used last byte are 0. With SSE2, the top bits of 16 pixels are
+ * gathered at once and each byte of them is put in the order of the file
+ * with a table.
+ *
+ * @param[out]  dst - bytes to write, (count + 7) / 8 of them.
+ * @param[in]   src - row of pixels, 0 for black and 255 for white.
+ * @param[in]   count - number of pixels in the row.
+ *
+ * @par Example
+ * @verbatim
+   vector<pixel> bits((img.cols + 7) / 8);
+   packBits(bits.data(), img.redGray[i], img.cols);
+   @endverbatim
+ *****************************************************************************/
+void packBits(pixel* dst, const pixel* src, int count)
+{
+    int j = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    //REVERSES THE BITS OF A BYTE, AS THE GATHERED BITS HAVE THE LEFTMOST PIXEL LOWEST
+    static const vector<pixel> reversed = []
+    {
+        vector<pixel> table(256);
+
+        for (int value = 0; value < 256; value++)
+        {
+            for (int bit = 0; bit < 8; bit++)
+            {
+                if (value & (1 << bit))
+                {
+                    table[value] |= pixel(0x80 >> bit);
+                }
+            }
+        }
+
+        return table;
+    }();
+
+    for (; j + 16 <= count; j += 16)
+    {
+        int white = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(src + j)));
+        int black = ~white;
+
+        dst[j / 8] = reversed[black & 0xFF];
+        dst[j / 8 + 1] = reversed[(black >> 8) & 0xFF];
+    }
+#endif
+
+    for (; j < count; j += 8)
+    {
+        pixel bits = 0;
+
+        for (int k = 0; k < 8 && j + k < count; k++)
+        {
+            if (src[j + k] < 128)
+            {
+                bits |= pixel(0x80 >> k);
+            }
+        }
+
+        dst[j / 8] = bits;
+    }
+}
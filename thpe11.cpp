@@ -14,6 +14,15 @@
 ************************************************************************/
 const bool RUNCATCH = false;
 
+//GLOBAL OPTIONS
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Global options of the current run, filled in by main.
+************************************************************************/
+settings config;
+
 //MAIN
 /** ***************************************************************************
  * @author Steve Nathan de Sa
@@ -21,12 +30,23 @@ const bool RUNCATCH = false;
  * @par Description
  * This function receives command line arguments and accordingly calls the
  * necessary functions to read the image, edit the image and output the image.
- * 
+ * When the input holds several images back to back, every one of them is
+ * edited and written to the output in turn.
+ *
+ * Global options, such as --cache, may come before the option code. With a
+ * cache, a job already done for the same input bytes, option and output type
+ * is answered from the cache without reading the image. With --batch, the
+ * basename and image are left off and the jobs are read from a list. With
+ * --compare, two images are read and compared instead of edited, and with
+ * --verify-goldens, every option is checked against the golden files.
  *
  * @param[in]  argc - contains number of command line arguments.
  * @param[in]  argv - contains the command line argument text.
  *
- * @return 0.
+ * @return 0, or 1 if an image of the job or of any job of a batch could not
+ *         be read. With --compare 0 if the images are identical, 1 if they
+ *         differ and 2 if either cannot be read, and with --verify-goldens
+ *         0 if every case passed and 1 if any failed.
  *
  * @par Example
  * @verbatim
@@ -51,153 +71,754 @@ int main(int argc, char** argv)
         }
     }
 
-    //4 ARGUMENTS
-    if (argc == 4)
+    string option;
+    string type;
+    string output;
+    string input;
+    vector<string> args;
+    size_t names;
+    int i;
+
+    //GLOBAL OPTIONS COME BEFORE THE OPTION CODE
+    for (i = 1; i < argc; i++)
     {
-        string output = argv[2];
-        string input = argv[3];
+        if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+        {
+            i++;
+            config.cacheDir = argv[i];
+        }
+        else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc)
+        {
+            i++;
+            config.cacheLimit = parseSize(argv[i]);
 
-        ifstream fin;
-        ofstream fout;
-        image img;
+            if (config.cacheLimit <= 0)
+            {
+                error("option");
+            }
+        }
+        else if (strcmp(argv[i], "--memory-limit") == 0 && i + 1 < argc)
+        {
+            i++;
+            config.memoryLimit = parseSize(argv[i]);
 
-        openIPFile(fin, input);
+            if (config.memoryLimit <= 0)
+            {
+                error("option");
+            }
+        }
+        else if (strcmp(argv[i], "--overlay-file") == 0 && i + 1 < argc)
+        {
+            i++;
+            config.overlayFile = argv[i];
+        }
+        else if (strcmp(argv[i], "--overlay-at") == 0 && i + 1 < argc)
+        {
+            i++;
 
-        if (readImage(fin, img))
+            if (sscanf(argv[i], "%d,%d", &config.overlayX, &config.overlayY) != 2)
+            {
+                error("option");
+            }
+        }
+        //THE NUMBER OF LEVELS FOLLOWS THE PYRAMID OPTION CODE
+        else if (strcmp(argv[i], "--pyramid") == 0 && i + 1 < argc)
         {
-            if (strcmp(argv[1], "--ascii") == 0)
+            i++;
+            config.pyramidLevels = atoi(argv[i]);
+
+            if (config.pyramidLevels < 1 || config.pyramidLevels > 24)
             {
-                img.magicNumber = "P3";
+                error("option");
             }
 
-            else if (strcmp(argv[1], "--binary") == 0)
+            args.push_back("--pyramid");
+        }
+
+        //AS IS THE METHOD OF THE DITHER OPTION CODE
+        else if (strcmp(argv[i], "--dither") == 0 && i + 1 < argc)
+        {
+            i++;
+            config.ditherMode = argv[i];
+
+            if (config.ditherMode != "fs" && config.ditherMode != "bayer")
+            {
+                error("option");
+            }
+
+            args.push_back("--dither");
+        }
+        else if (strcmp(argv[i], "--huge-pages") == 0)
+        {
+            config.hugePages = true;
+        }
+        else if (strcmp(argv[i], "--profile") == 0)
+        {
+            config.profile = true;
+        }
+        else if (strcmp(argv[i], "--yuv-matrix") == 0 && i + 1 < argc)
+        {
+            i++;
+            config.yuvMatrix = atoi(argv[i]);
+
+            if (config.yuvMatrix != 601 && config.yuvMatrix != 709)
             {
-                img.magicNumber = "P6";
+                error("option");
             }
+        }
+        else if (strcmp(argv[i], "--yuv-range") == 0 && i + 1 < argc)
+        {
+            i++;
 
-            else
+            if (strcmp(argv[i], "full") != 0 && strcmp(argv[i], "limited") != 0)
             {
-                error("output");
+                error("option");
             }
 
-            writeImage(fout, img, output);
+            config.yuvFull = strcmp(argv[i], "full") == 0;
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            i++;
+            config.batchFile = argv[i];
         }
         else
         {
-            cout << "Unable to allocate memory for storage." << endl;
-            exit(0);
+            args.push_back(argv[i]);
         }
     }
 
-    //5 ARGUMENTS
-    else if (argc == 5)
+    //COMPARING TWO IMAGES TAKES A METRIC AND TWO IMAGES INSTEAD
+    if (!args.empty() && args[0] == "--compare")
     {
-        string type = argv[2];
-        string output = argv[3];
-        string input = argv[4];
+        if (args.size() != 4 || !config.batchFile.empty())
+        {
+            error("xxx");
+        }
 
-        ifstream fin;
-        ofstream fout;
-        image img;
+        if (args[1] != "exact" && args[1] != "maxdiff" && args[1] != "psnr" && args[1] != "ssim")
+        {
+            error("option");
+        }
 
-        openIPFile(fin, input);
+        return compareImages(args[1], args[2], args[3]);
+    }
 
-        if (strcmp(argv[1], "--flipX") == 0)
+    //CHECKING THE GOLDEN FILES TAKES THEIR DIRECTORY AND A BASELINE INSTEAD
+    if (!args.empty() && args[0] == "--verify-goldens")
+    {
+        if (args.size() < 2 || args.size() > 3 || !config.batchFile.empty())
         {
-            if (readImage(fin, img))
-            {
-                flipX(img, type);
-                writeImage(fout, img, output);
-            }
-            else
-            {
-                cout << "Unable to allocate memory for storage." << endl;
-                exit(0);
-            }
+            error("xxx");
         }
 
-        else if (strcmp(argv[1], "--flipY") == 0)
+        return verifyGoldens(args[1], args.size() == 3 ? args[2] : "");
+    }
+
+    //THE MAIN THREAD IS COUNTED FROM THE START
+    profileThread();
+
+    //A BATCH LIST GIVES THE BASENAME AND IMAGE OF EVERY JOB INSTEAD
+    names = config.batchFile.empty() ? 2 : 0;
+
+    //3 ARGUMENTS
+    if (args.size() == 1 + names)
+    {
+        type = args[0];
+
+        if (names > 0)
         {
-            if (readImage(fin, img))
-            {
-                flipY(img, type);
-                writeImage(fout, img, output);
-            }
-            else
-            {
-                cout << "Unable to allocate memory for storage." << endl;
-                exit(0);
-            }
+            output = args[1];
+            input = args[2];
         }
+    }
 
-        else if (strcmp(argv[1], "--rotateCW") == 0)
+    //4 ARGUMENTS
+    else if (args.size() == 2 + names)
+    {
+        option = args[0];
+        type = args[1];
+
+        if (names > 0)
         {
-            if (readImage(fin, img))
-            {
-                rotateCW(img, type);
-                writeImage(fout, img, output);
-            }
-            else
-            {
-                cout << "Unable to allocate memory for storage." << endl;
-                exit(0);
-            }
+            output = args[2];
+            input = args[3];
         }
 
-        else if (strcmp(argv[1], "--rotateCCW") == 0)
+        if (!isOption(option)) //INVALID OPTION
         {
-            if (readImage(fin, img))
-            {
-                rotateCCW(img, type);
-                writeImage(fout, img, output);
-            }
-            else
-            {
-                cout << "Unable to allocate memory for storage." << endl;
-                exit(0);
-            }
+            error("option");
         }
 
-        else if (strcmp(argv[1], "--grayscale") == 0)
+        if (option == "--overlay" && config.overlayFile.empty())
         {
-            if (readImage(fin, img))
-            {
-                grayscale(img, type);
-                writeImage(fout, img, output);
-            }
-            else
-            {
-                cout << "Unable to allocate memory for storage." << endl;
-                exit(0);
-            }
+            error("option");
+        }
+    }
+
+    //INVALID NUMBER OF ARGS
+    else
+    {
+        error("xxx");
+    }
+
+    if (!config.batchFile.empty())
+    {
+        //THE MEMORY PLAN AND THE PROFILE ARE MADE FOR ONE JOB AT A TIME
+        if (config.memoryLimit > 0 || config.profile)
+        {
+            error("option");
         }
 
-        else if (strcmp(argv[1], "--sepia") == 0)
+        return runBatch(option, type, config.batchFile) ? 0 : 1;
+    }
+
+    //EVERY LEVEL OF A PYRAMID NEEDS A FILE OF ITS OWN
+    if (option == "--pyramid" && output == "-")
+    {
+        error("option");
+    }
+
+    return runJob(option, type, output, input) ? 0 : 1;
+}
+
+//KEY OF A JOB
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function builds the cache key of a job from its input, option code
+ * and output type, and the settings that change its result: the overlay
+ * by its content and position, the method of --dither and the matrix and
+ * range of --yuv. Statistics are printed and pyramids write several files,
+ * so neither is cached, nor is standard input.
+ *
+ * @param[in]  option - option code given on the command line.
+ * @param[in]  type - contains type of output file needed.
+ * @param[in]  input - name of the input file.
+ *
+ * @return the key, or an empty string if the job is not cached.
+ *
+ * @par Example
+ * @verbatim
+   string key = jobKey("--dither", "--binary", "BalloonsX.ppm");
+   @endverbatim
+ *****************************************************************************/
+string jobKey(string option, string type, string input)
+{
+    string job = option;
+
+    if (input == "-" || option == "--stats" || option == "--pyramid")
+    {
+        return "";
+    }
+
+    if (option == "--overlay")
+    {
+        job += " " + cacheKey(config.overlayFile, "", "") + " " +
+            to_string(config.overlayX) + "," + to_string(config.overlayY);
+    }
+
+    if (option == "--dither")
+    {
+        job += " " + config.ditherMode;
+    }
+
+    if (type == "--yuv")
+    {
+        job += " " + to_string(config.yuvMatrix) + (config.yuvFull ? " full" : " limited");
+    }
+
+    return cacheKey(input, job, type);
+}
+
+//RUN ONE JOB
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function does one job: it answers it from the cache if one is given
+ * and holds the result, and otherwise plans its memory if a limit is set,
+ * processes every frame of the input and stores the result in the cache.
+ * Jobs of a batch run at the same time, so the cache is used by one job at
+ * a time.
+ *
+ * @param[in]  option - option code given on the command line.
+ * @param[in]  type - contains type of output file needed.
+ * @param[in]  output - base name of the output file.
+ * @param[in]  input - name of the input file.
+ *
+ * @return true if the job was done, false if its image could not be read
+ *         or it cannot fit under the memory limit.
+ *
+ * @par Example
+ * @verbatim
+   runJob("--sepia", "--binary", "sepiabb", "BalloonsX.ppm");
+   @endverbatim
+ *****************************************************************************/
+bool runJob(string option, string type, string output, string input)
+{
+    static mutex cacheLock;
+    string key;
+    string written;
+
+    if (!config.cacheDir.empty())
+    {
+        key = jobKey(option, type, input);
+    }
+
+    if (!key.empty())
+    {
+        lock_guard<mutex> guard(cacheLock);
+
+        if (cacheLookup(config.cacheDir, key, output))
         {
-            if (readImage(fin, img))
-            {
-                sepia(img, type);
-                writeImage(fout, img, output);
-            }
-            else
+            return true;
+        }
+    }
+
+    //STANDARD OUTPUT IS NOT YET REDIRECTED HERE, SO THE PLAN GOES TO CERR
+    if (config.memoryLimit > 0 && !planMemory(output == "-" ? cerr : cout, option, type, input))
+    {
+        return false;
+    }
+
+    written = processFrames(option, type, output, input);
+
+    if (written.empty())
+    {
+        return false;
+    }
+
+    if (config.memoryLimit > 0)
+    {
+        reportMemory(cout);
+    }
+
+    printProfile(output == "-" ? cerr : cout);
+
+    if (!key.empty() && written != "-")
+    {
+        lock_guard<mutex> guard(cacheLock);
+
+        cacheStore(config.cacheDir, key, written, config.cacheLimit);
+    }
+
+    return true;
+}
+
+//RUN A BATCH
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function does the same option and output type for every job in a
+ * batch list, a text file with the base name of the output and the name of
+ * the input on each line. Every job is a task of the work stealing
+ * scheduler, so the workers share the jobs out among themselves, and the
+ * bands of a large image are stolen by workers that have run out of jobs.
+ * Blank lines are skipped. The program ends with a message, before any job
+ * is started, if a line does not name exactly two files or uses standard
+ * input or output. A job whose image cannot be read prints a message and
+ * fails on its own, while the other jobs carry on.
+ *
+ * @param[in]  option - option code given on the command line.
+ * @param[in]  type - contains type of output file needed.
+ * @param[in]  list - name of the batch list.
+ *
+ * @return true if every job was done.
+ *
+ * @par Example
+ * @verbatim
+   //jobs.txt holds the lines "icon1 icon1.ppm" and "scan scan.ppm"
+   runBatch("--rotateCW", "--binary", "jobs.txt");
+   //writes icon1.ppm and scan.ppm rotated
+   @endverbatim
+ *****************************************************************************/
+bool runBatch(string option, string type, string list)
+{
+    ifstream fin;
+    string line;
+    vector<pair<string, string>> jobs;
+    taskGroup group;
+    atomic<int> failures(0);
+    int number = 0;
+    size_t i;
+
+    openIPFile(fin, list);
+
+    while (getline(fin, line))
+    {
+        istringstream words(line);
+        string output;
+        string input;
+        string extra;
+
+        number++;
+
+        if (!(words >> output))
+        {
+            continue;
+        }
+
+        if (!(words >> input) || (words >> extra) || output == "-" || input == "-")
+        {
+            cout << "Line " << number << " of " << list
+                << " must give a basename and an image file" << endl;
+            exit(0);
+        }
+
+        jobs.push_back({ output, input });
+    }
+
+    fin.close();
+
+    for (i = 0; i < jobs.size(); i++)
+    {
+        string output = jobs[i].first;
+        string input = jobs[i].second;
+
+        runTask(group, [=, &failures]
+        {
+            if (!runJob(option, type, output, input))
             {
-                cout << "Unable to allocate memory for storage." << endl;
-                exit(0);
+                failures++;
             }
-        }
+        });
+    }
+
+    waitTasks(group);
+
+    return failures == 0;
+}
+
+//PARSE SIZE
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function converts a size given on the command line into bytes. The
+ * number may end in K, M or G for kibibytes, mebibytes or gibibytes.
+ *
+ * @param[in]  text - size as typed by the user.
+ *
+ * @return the size in bytes, or -1 if the text is not a valid size.
+ *
+ * @par Example
+ * @verbatim
+   long long bytes = parseSize("512M"); //536870912
+   @endverbatim
+ *****************************************************************************/
+long long parseSize(string text)
+{
+    long long value = 0;
+    size_t i = 0;
 
-        else //INVALID OPTION
+    while (i < text.size() && isdigit((unsigned char)text[i]) && value < (1LL << 50))
+    {
+        value = value * 10 + (text[i] - '0');
+        i++;
+    }
+
+    if (i == 0)
+    {
+        return -1;
+    }
+
+    if (i + 1 == text.size())
+    {
+        switch (toupper((unsigned char)text[i]))
         {
-            fin.close();
-            error("option");
+        case 'K':
+            return value << 10;
+        case 'M':
+            return value << 20;
+        case 'G':
+            return value << 30;
+        default:
+            return -1;
         }
     }
 
-    //INVALID NUMBER OF ARGS
+    if (i != text.size())
+    {
+        return -1;
+    }
+
+    return value;
+}
+
+//VALID OPTION
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function checks whether an option code names one of the operations.
+ *
+ * @param[in]  option - option code given on the command line.
+ *
+ * @return true if the option is known.
+ *
+ * @par Example
+ * @verbatim
+   if (!isOption(argv[1]))
+   {
+       error("option");
+   }
+   @endverbatim
+ *****************************************************************************/
+bool isOption(string option)
+{
+    return option == "--flipX" || option == "--flipY" ||
+        option == "--rotateCW" || option == "--rotateCCW" ||
+        option == "--rotate180" || option == "--transpose" ||
+        option == "--transverse" ||
+        option == "--grayscale" || option == "--sepia" ||
+        option == "--stats" || option == "--autolevels" ||
+        option == "--overlay" || option == "--pyramid" ||
+        option == "--dither";
+}
+
+//APPLY OPTION
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function calls the operation named by the option code on the image.
+ * An empty option only converts the image to the given output type.
+ *
+ * @param[in]       option - option code given on the command line.
+ * @param[in, out]  img - defined image structure to edit.
+ * @param[in]       type - contains type of output file needed.
+ * @param[in]       stats - statistics gathered while reading, or nullptr.
+ *
+ * @par Example
+ * @verbatim
+   if (readImage(fin, img))
+   {
+       applyOption("--sepia", img, "--binary", nullptr);
+   }
+   @endverbatim
+ *****************************************************************************/
+void applyOption(string option, image& img, string type, imageStats* stats)
+{
+    if (option == "--flipX")
+    {
+        flipX(img, type);
+    }
+    else if (option == "--flipY")
+    {
+        flipY(img, type);
+    }
+    else if (option == "--rotateCW")
+    {
+        rotateCW(img, type);
+    }
+    else if (option == "--rotateCCW")
+    {
+        rotateCCW(img, type);
+    }
+    else if (option == "--rotate180")
+    {
+        rotate180(img, type);
+    }
+    else if (option == "--transpose")
+    {
+        transpose(img, type);
+    }
+    else if (option == "--transverse")
+    {
+        transverse(img, type);
+    }
+    else if (option == "--grayscale")
+    {
+        grayscale(img, type);
+    }
+    else if (option == "--sepia")
+    {
+        sepia(img, type);
+    }
+    else if (option == "--stats")
+    {
+        statistics(img, type, stats);
+    }
+    else if (option == "--autolevels")
+    {
+        autolevels(img, type, stats);
+    }
+    else if (option == "--overlay")
+    {
+        overlay(img, type);
+    }
+    else if (option == "--dither")
+    {
+        dither(img, type);
+    }
     else
     {
-        error("xxx");
+        setOutputType(img, type, false);
+    }
+}
+
+//PROCESS ALL FRAMES
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function reads every image of the input file, applies the option to
+ * it and writes it to the output file. An ordinary file holds one image,
+ * while a multi image stream, such as the frames dumped by a camera, holds
+ * several back to back and gives an output file with the same frames. The
+ * planes are reused from frame to frame whenever the size stays the same.
+ * A pyramid is made from the first image only and written by pyramid, to
+ * files of its own. A single binary image is flipped straight from file to
+ * file by streamMirror where it can be, and otherwise worked as a pipeline
+ * of row bands by pipelineImage when the option works row by row.
+ *
+ * Either name may be "-" to read from standard input or write to standard
+ * output. Neither has to be seekable, so the program works between two
+ * other programs in a shell pipeline without temporary files.
+ *
+ * @param[in]  option - option code given on the command line.
+ * @param[in]  type - contains type of output file needed.
+ * @param[in]  output - base name of the output file.
+ * @param[in]  input - name of the input file.
+ *
+ * @return name of the file written, with its extension, or "-", or an
+ *         empty string if the input could not be opened or its first image
+ *         could not be read.
+ *
+ * @par Example
+ * @verbatim
+   processFrames("--flipX", "--binary", "flipped", "video.ppm");
+   //every frame of video.ppm is flipped into flipped.ppm
+   processFrames("--sepia", "--binary", "-", "-");
+   //every frame piped in is written to standard output in sepia
+   @endverbatim
+ *****************************************************************************/
+string processFrames(string option, string type, string output, string input)
+{
+    ifstream fin;
+    ofstream fout;
+    image img;
+    imageStats stats;
+    imageStats* frameStats = nullptr;
+    int frame = 1;
+    streambuf* sink = nullptr;
+
+    if (option == "--stats" || option == "--autolevels")
+    {
+        frameStats = &stats;
+    }
+
+    beginStage("open input");
+
+    //A MISSING INPUT ONLY FAILS THIS JOB, NOT THE OTHER JOBS OF A BATCH
+    if (input != "-" && !ifstream(input, ios::binary).is_open())
+    {
+        cout << "Unable to open the file: " << input << endl;
+        return "";
+    }
+
+    //FLIPS OF A LARGE BINARY FILE NEED NOT LOAD THE IMAGE AT ALL
+    if (streamMirror(option, type, output, input))
+    {
+        return output;
+    }
+
+    //NOR NEED OPTIONS THAT WORK ROW BY ROW, WHICH RUN AS A PIPELINE OF BANDS
+    if (pipelineImage(option, type, output, input))
+    {
+        return output;
+    }
+
+    //STANDARD OUTPUT IS CLAIMED FIRST SO NO MESSAGE ENDS UP IN THE IMAGE
+    if (output == "-")
+    {
+        sink = openOutput(fout, output);
+    }
+
+    prefetchBuf ahead(openInput(fin, input));
+    istream in(&ahead);
+
+    beginStage("header");
+
+    if (!readImage(in, img, frameStats))
+    {
+        cout << "Unable to read the image file: " << input << endl;
+        freeimage(img);
+        return "";
+    }
+
+    stageBytes(img);
+    beginStage(option.empty() ? "convert" : option);
+
+    if (option == "--pyramid")
+    {
+        pyramid(img, type, output);
+        stageBytes(img);
+
+        if (nextFrame(in))
+        {
+            cout << "Only the first image of " << input << " is used for the pyramid" << endl;
+        }
+
+        freeimage(img);
+
+        return output;
     }
+
+    applyOption(option, img, type, frameStats);
+    stageBytes(img);
+
+    output = outputName(img, output);
+
+    beginStage("open output");
+
+    if (sink == nullptr)
+    {
+        sink = openOutput(fout, output);
+    }
+
+    {
+        writeBehindBuf behind(sink);
+        ostream out(&behind);
+
+        beginStage("encode");
+        writeImageData(out, img);
+        stageBytes(img);
+        beginStage("header");
+
+        while (nextFrame(in))
+        {
+            frame++;
+
+            if (!readImage(in, img, frameStats))
+            {
+                cout << "Unable to read frame " << frame << " of " << input << endl;
+                break;
+            }
+
+            stageBytes(img);
+            beginStage(option.empty() ? "convert" : option);
+            applyOption(option, img, type, frameStats);
+            stageBytes(img);
+            beginStage("encode");
+            writeImageData(out, img);
+            stageBytes(img);
+            beginStage("header");
+        }
+
+        beginStage("flush output");
+        out.flush();
+    }
+
+    fout.close();
+    endStage();
+
+    freeimage(img);
+
+    return output;
 }
 
 //ARGUMENT ERROR
@@ -235,18 +856,49 @@ void error (string type)
         cout << "Invalid output type specified" << endl;
     }
 
-    cout << "thpe11.exe [option] --outputtype basename image.ppm" << endl;
+    cout << "thpe11.exe [global options] [option] --outputtype basename image.ppm" << endl;
+    cout << "thpe11.exe --compare exact|maxdiff|psnr|ssim reference.ppm image.ppm" << endl;
+    cout << "thpe11.exe --verify-goldens directory [baseline.txt]" << endl;
+    cout << "Use - as basename to write to standard output, and as image.ppm" << endl;
+    cout << "to read from standard input." << endl;
     cout << endl;
     cout << "Output Type      Output Description" << endl;
     cout << "    --ascii      integer text numbers will be written for the data" << endl;
     cout << "    --binary     integer number will be written in binary form" << endl;
+    cout << "    --planar     planes are written as they are held in memory" << endl;
+    cout << "    --compressed planes are written delta filtered and LZ4 compressed" << endl;
+    cout << "    --pam        PAM image, keeping the alpha channel" << endl;
+    cout << "    --yuv        raw planar YUV 4:2:0 for video encoders" << endl;
     cout << endl;
     cout << "Option Code      Option Description" << endl;
     cout << "    --flipX      Flip the image on the X axis" << endl;
     cout << "    --flipY      Flip the image on the Y axis" << endl;
     cout << "    --rotateCW   Rotate the image clockwise" << endl;
     cout << "    --rotateCCW  Rotate the image counter clockwise" << endl;
+    cout << "    --rotate180  Rotate the image half a turn" << endl;
+    cout << "    --transpose  Flip the image over its main diagonal" << endl;
+    cout << "    --transverse Flip the image over its other diagonal" << endl;
     cout << "    --grayscale  Convert image to grayscale" << endl;
     cout << "    --sepia      Antique a color image" << endl;
+    cout << "    --overlay    Blend the overlay file on top of the image" << endl;
+    cout << "    --pyramid N  Write N levels, each half the size of the last" << endl;
+    cout << "    --dither fs|bayer  Black and white bitmap, P1 or P4, by Floyd" << endl;
+    cout << "                 Steinberg error diffusion or an ordered Bayer matrix" << endl;
+    cout << "    --stats      Print channel minimum, maximum and mean" << endl;
+    cout << "    --autolevels Stretch each channel to the full range" << endl;
+    cout << endl;
+    cout << "Global Option          Option Description" << endl;
+    cout << "    --cache dir          Reuse results of identical jobs stored in dir" << endl;
+    cout << "    --cache-size size    Largest size of the cache, such as 512M or 2G" << endl;
+    cout << "    --memory-limit size  Keep the memory used under size, such as 256M" << endl;
+    cout << "    --huge-pages         Place large images on huge pages" << endl;
+    cout << "    --overlay-file file  Image blended on top by --overlay" << endl;
+    cout << "    --overlay-at x,y     Position of the overlay, 0,0 by default" << endl;
+    cout << "    --batch list         Do the job for every basename and image.ppm" << endl;
+    cout << "                         line in list, leaving both off the command" << endl;
+    cout << "    --yuv-matrix 601|709 Colors of --yuv as BT.601, the default, or BT.709" << endl;
+    cout << "    --yuv-range full     Full range --yuv, rather than 16 to 235" << endl;
+    cout << "    --profile            Print the time and hardware counters of every" << endl;
+    cout << "                         stage: header, decode, option, encode and I/O" << endl;
     exit(0);
 }
\ No newline at end of file
@@ -0,0 +1,70 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+//NUMBER OF TILES
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function returns how many TILE_SIZE by TILE_SIZE tiles are needed to
+ * cover an image of the given size. Tiles on the right and bottom edges may
+ * be smaller than TILE_SIZE.
+ *
+ * @param[in]  rows - number of rows in the image.
+ * @param[in]  cols - number of columns in the image.
+ *
+ * @return number of tiles covering the image.
+ *
+ * @par Example
+ * @verbatim
+   int n = tileCount(486, 735); //8 tiles down, 12 across, so 96
+   @endverbatim
+ *****************************************************************************/
+int tileCount(int rows, int cols)
+{
+    int down = (rows + TILE_SIZE - 1) / TILE_SIZE;
+    int across = (cols + TILE_SIZE - 1) / TILE_SIZE;
+
+    return down * across;
+}
+
+//TILE AT INDEX
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function returns the area covered by one tile of an image. Tiles are
+ * numbered left to right, top to bottom, from 0 up to but not including
+ * tileCount(rows, cols), so looping over the indexes visits the whole image
+ * one cache sized block at a time.
+ *
+ * @param[in]  rows - number of rows in the image.
+ * @param[in]  cols - number of columns in the image.
+ * @param[in]  index - number of the tile.
+ *
+ * @return the first row, first column and size of the tile.
+ *
+ * @par Example
+ * @verbatim
+   for (t = 0; t < tileCount(img.rows, img.cols); t++)
+   {
+       tileRect r = tileAt(img.rows, img.cols, t);
+       //process rows r.row to r.row + r.rows - 1
+       //and columns r.col to r.col + r.cols - 1
+   }
+   @endverbatim
+ *****************************************************************************/
+tileRect tileAt(int rows, int cols, int index)
+{
+    tileRect rect;
+    int across = (cols + TILE_SIZE - 1) / TILE_SIZE;
+
+    rect.row = (index / across) * TILE_SIZE;
+    rect.col = (index % across) * TILE_SIZE;
+    rect.rows = min(TILE_SIZE, rows - rect.row);
+    rect.cols = min(TILE_SIZE, cols - rect.col);
+
+    return rect;
+}
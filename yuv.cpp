@@ -0,0 +1,341 @@
+/** **************************************************************************
+ * @file
+ ****************************************************************************/
+#include "netPBM.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+/** **********************************************************************
+* @author Steve Nathan de Sa
+*
+* @par Description
+* Fixed point weights of red, green and blue for one of Y, Cb or Cr, in
+* units of 1/16384, and the value the weighted sum starts from.
+************************************************************************/
+struct yuvWeights
+{
+    int red;
+    int green;
+    int blue;
+    int offset;
+};
+
+//YUV WEIGHTS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function works out the fixed point weights of Y, Cb and Cr for the
+ * matrix and range given with --yuv-matrix and --yuv-range. BT.601 weighs
+ * red 0.299 and blue 0.114, BT.709 0.2126 and 0.0722. Full range uses all
+ * of 0 to 255, limited range 16 to 235 for Y and 16 to 240 for Cb and Cr.
+ * The green weight takes up the rounding, so white is exactly the top of
+ * the range and every gray has Cb and Cr of exactly 128.
+ *
+ * @param[out]  y - weights of Y.
+ * @param[out]  cb - weights of Cb.
+ * @param[out]  cr - weights of Cr.
+ *
+ * @par Example
+ * @verbatim
+   yuvWeights y, cb, cr;
+   yuvMatrix(y, cb, cr);
+   @endverbatim
+ *****************************************************************************/
+static void yuvMatrix(yuvWeights& y, yuvWeights& cb, yuvWeights& cr)
+{
+    double kr = config.yuvMatrix == 709 ? 0.2126 : 0.299;
+    double kb = config.yuvMatrix == 709 ? 0.0722 : 0.114;
+    double luma = config.yuvFull ? 16384.0 : 16384.0 * 219 / 255;
+    double chroma = config.yuvFull ? 16384.0 : 16384.0 * 224 / 255;
+
+    y.red = int(round(kr * luma));
+    y.blue = int(round(kb * luma));
+    y.green = int(round(luma)) - y.red - y.blue;
+    y.offset = config.yuvFull ? 0 : 16;
+
+    cb.red = int(round(-kr / (2 * (1 - kb)) * chroma));
+    cb.blue = int(round(0.5 * chroma));
+    cb.green = -cb.red - cb.blue;
+    cb.offset = 128;
+
+    cr.red = int(round(0.5 * chroma));
+    cr.blue = int(round(-kb / (2 * (1 - kr)) * chroma));
+    cr.green = -cr.red - cr.blue;
+    cr.offset = 128;
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+//WEIGHT 8 PIXELS
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function applies weights to 8 pixels held as 16 bit lanes, as
+ * (weights * samples + offset * scale + scale / 2) >> shift, and returns
+ * the 8 results as 16 bit lanes. Red and green are multiplied and added in
+ * pairs by one multiply add, and blue by another.
+ *
+ * @param[in]  r - red samples, or sums of samples.
+ * @param[in]  g - green samples, or sums of samples.
+ * @param[in]  b - blue samples, or sums of samples.
+ * @param[in]  w - weights to apply.
+ * @param[in]  shift - 14 for single pixels, 16 for sums of 4.
+ *
+ * @return the 8 results.
+ *
+ * @par Example
+ * @verbatim
+   __m128i luma = weigh8(r16, g16, b16, y, 14);
+   @endverbatim
+ *****************************************************************************/
+static __m128i weigh8(__m128i r, __m128i g, __m128i b, const yuvWeights& w, int shift)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i redGreen = _mm_set_epi16(short(w.green), short(w.red), short(w.green),
+        short(w.red), short(w.green), short(w.red), short(w.green), short(w.red));
+    const __m128i blue = _mm_set_epi16(0, short(w.blue), 0, short(w.blue), 0, short(w.blue),
+        0, short(w.blue));
+    const __m128i offset = _mm_set1_epi32((w.offset << shift) + (1 << (shift - 1)));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r, g), redGreen),
+        _mm_madd_epi16(_mm_unpacklo_epi16(b, zero), blue));
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r, g), redGreen),
+        _mm_madd_epi16(_mm_unpackhi_epi16(b, zero), blue));
+
+    lo = _mm_sra_epi32(_mm_add_epi32(lo, offset), count);
+    hi = _mm_sra_epi32(_mm_add_epi32(hi, offset), count);
+
+    return _mm_packs_epi32(lo, hi);
+}
+
+//SUM 2 BY 2 BOXES
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function adds up the 2 by 2 boxes of 16 pixels of two rows, giving
+ * 8 sums as 16 bit lanes.
+ *
+ * @param[in]  top - 16 pixels of the upper row.
+ * @param[in]  bottom - 16 pixels of the lower row.
+ *
+ * @return the 8 sums.
+ *
+ * @par Example
+ * @verbatim
+   __m128i sums = boxSums8(_mm_loadu_si128(upper), _mm_loadu_si128(lower));
+   @endverbatim
+ *****************************************************************************/
+static __m128i boxSums8(__m128i top, __m128i bottom)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+
+    return _mm_packs_epi32(_mm_madd_epi16(lo, ones), _mm_madd_epi16(hi, ones));
+}
+#endif
+
+//CONVERT A ROW TO Y
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function converts one row of red, green and blue to Y, 16 pixels at
+ * a time with SSE2 and the rest one at a time.
+ *
+ * @param[in]   r - red row.
+ * @param[in]   g - green row.
+ * @param[in]   b - blue row.
+ * @param[out]  dst - Y row to write.
+ * @param[in]   w - weights of Y.
+ * @param[in]   count - number of pixels in the row.
+ *
+ * @par Example
+ * @verbatim
+   lumaRow(img.redGray[i], img.green[i], img.blue[i], luma, y, img.cols);
+   @endverbatim
+ *****************************************************************************/
+static void lumaRow(const pixel* r, const pixel* g, const pixel* b, pixel* dst,
+    const yuvWeights& w, int count)
+{
+    int j = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; j + 16 <= count; j += 16)
+    {
+        __m128i vr = _mm_loadu_si128((const __m128i*)(r + j));
+        __m128i vg = _mm_loadu_si128((const __m128i*)(g + j));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+
+        __m128i lo = weigh8(_mm_unpacklo_epi8(vr, zero), _mm_unpacklo_epi8(vg, zero),
+            _mm_unpacklo_epi8(vb, zero), w, 14);
+        __m128i hi = weigh8(_mm_unpackhi_epi8(vr, zero), _mm_unpackhi_epi8(vg, zero),
+            _mm_unpackhi_epi8(vb, zero), w, 14);
+
+        _mm_storeu_si128((__m128i*)(dst + j), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; j < count; j++)
+    {
+        int value = (w.red * r[j] + w.green * g[j] + w.blue * b[j] + (w.offset << 14) +
+            (1 << 13)) >> 14;
+
+        dst[j] = pixel(min(max(value, 0), 255));
+    }
+}
+
+//CONVERT TWO ROWS TO CB AND CR
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function makes one row of Cb and Cr from two rows of the image, each
+ * chroma sample from the sums of a 2 by 2 box of red, green and blue, so
+ * the downsampling costs no pass of its own. The last box of a row with an
+ * odd width counts its one column twice. With SSE2, 8 boxes are done at a
+ * time.
+ *
+ * @param[in]   r - upper and lower red rows.
+ * @param[in]   g - upper and lower green rows.
+ * @param[in]   b - upper and lower blue rows.
+ * @param[out]  u - Cb row to write, (count + 1) / 2 samples.
+ * @param[out]  v - Cr row to write, (count + 1) / 2 samples.
+ * @param[in]   cb - weights of Cb.
+ * @param[in]   cr - weights of Cr.
+ * @param[in]   count - number of pixels in the image rows.
+ *
+ * @par Example
+ * @verbatim
+   const pixel* r[2] = { img.redGray[2 * k], img.redGray[2 * k + 1] };
+   chromaRow(r, g, b, u, v, cb, cr, img.cols);
+   @endverbatim
+ *****************************************************************************/
+static void chromaRow(const pixel* const r[2], const pixel* const g[2],
+    const pixel* const b[2], pixel* u, pixel* v, const yuvWeights& cb,
+    const yuvWeights& cr, int count)
+{
+    int k = 0;
+    int half = (count + 1) / 2;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    for (; 2 * k + 16 <= count; k += 8)
+    {
+        __m128i sr = boxSums8(_mm_loadu_si128((const __m128i*)(r[0] + 2 * k)),
+            _mm_loadu_si128((const __m128i*)(r[1] + 2 * k)));
+        __m128i sg = boxSums8(_mm_loadu_si128((const __m128i*)(g[0] + 2 * k)),
+            _mm_loadu_si128((const __m128i*)(g[1] + 2 * k)));
+        __m128i sb = boxSums8(_mm_loadu_si128((const __m128i*)(b[0] + 2 * k)),
+            _mm_loadu_si128((const __m128i*)(b[1] + 2 * k)));
+
+        __m128i cu = weigh8(sr, sg, sb, cb, 16);
+        __m128i cv = weigh8(sr, sg, sb, cr, 16);
+
+        _mm_storel_epi64((__m128i*)(u + k), _mm_packus_epi16(cu, cu));
+        _mm_storel_epi64((__m128i*)(v + k), _mm_packus_epi16(cv, cv));
+    }
+#endif
+
+    for (; k < half; k++)
+    {
+        int left = 2 * k;
+        int right = min(2 * k + 1, count - 1);
+        int sr = r[0][left] + r[0][right] + r[1][left] + r[1][right];
+        int sg = g[0][left] + g[0][right] + g[1][left] + g[1][right];
+        int sb = b[0][left] + b[0][right] + b[1][left] + b[1][right];
+        int valueU = (cb.red * sr + cb.green * sg + cb.blue * sb + (cb.offset << 16) +
+            (1 << 15)) >> 16;
+        int valueV = (cr.red * sr + cr.green * sg + cr.blue * sb + (cr.offset << 16) +
+            (1 << 15)) >> 16;
+
+        u[k] = pixel(min(max(valueU, 0), 255));
+        v[k] = pixel(min(max(valueV, 0), 255));
+    }
+}
+
+//WRITE YUV
+/** ***************************************************************************
+ * @author Steve Nathan de Sa
+ *
+ * @par Description
+ * This function writes an image as raw planar YUV 4:2:0, the input most
+ * video encoders take: the Y plane at full size, then the Cb and Cr planes
+ * at half the width and height, rounded up, with no header. The frames of a
+ * stream follow each other. Every pair of rows is converted to Y and to one
+ * row of Cb and Cr in the same pass while it is in the cache, and the pairs
+ * are split into bands for the threads. A gray image has Cb and Cr of 128.
+ *
+ * @param[in, out]  out - stream to write the image to.
+ * @param[in]       img - defined image structure to obtain data from.
+ *
+ * @par Example
+ * @verbatim
+   setOutputType(img, "--yuv", false);
+   writeYUV(out, img);
+   @endverbatim
+ *****************************************************************************/
+void writeYUV(ostream& out, image& img)
+{
+    yuvWeights y, cb, cr;
+    bool gray = img.magicNumber == "YUVG";
+    int halfRows = (img.rows + 1) / 2;
+    int halfCols = (img.cols + 1) / 2;
+    size_t lumaSize = size_t(img.rows) * img.cols;
+    size_t chromaSize = size_t(halfRows) * halfCols;
+    vector<pixel> frame(lumaSize + 2 * chromaSize);
+    pixel* luma = frame.data();
+    pixel* u = luma + lumaSize;
+    pixel* v = u + chromaSize;
+
+    yuvMatrix(y, cb, cr);
+    trackMemory((long long)frame.size());
+
+    //A GRAY IMAGE KEEPS ITS LEVELS IN THE FIRST PLANE ONLY
+    pixel** green = gray ? img.redGray : img.green;
+    pixel** blue = gray ? img.redGray : img.blue;
+
+    parallelBands(halfRows, [&](int, int first, int last)
+    {
+        for (int k = first; k < last; k++)
+        {
+            int upper = 2 * k;
+            int lower = min(2 * k + 1, img.rows - 1);
+
+            lumaRow(img.redGray[upper], green[upper], blue[upper],
+                luma + size_t(upper) * img.cols, y, img.cols);
+
+            if (lower != upper)
+            {
+                lumaRow(img.redGray[lower], green[lower], blue[lower],
+                    luma + size_t(lower) * img.cols, y, img.cols);
+            }
+
+            if (gray)
+            {
+                memset(u + size_t(k) * halfCols, 128, halfCols);
+                memset(v + size_t(k) * halfCols, 128, halfCols);
+                continue;
+            }
+
+            const pixel* r[2] = { img.redGray[upper], img.redGray[lower] };
+            const pixel* g[2] = { green[upper], green[lower] };
+            const pixel* b[2] = { blue[upper], blue[lower] };
+
+            chromaRow(r, g, b, u + size_t(k) * halfCols, v + size_t(k) * halfCols,
+                cb, cr, img.cols);
+        }
+    });
+
+    out.write((char*)frame.data(), streamsize(frame.size()));
+
+    trackMemory(-(long long)frame.size());
+}